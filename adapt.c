@@ -0,0 +1,426 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* adapt.c
+ * Trades filter quality for time when the machine is overloaded.  Each
+ * block is timed against the time it will take to play; when rendering
+ * takes too large a share, the filter steps down to half its taps, then a
+ * quarter, and finally to a two-pole IIR lowpass at the same cutoff.
+ * Each step is logged and counted.  Once the load has stayed low for a
+ * while, the filter steps back up, crossfading from the cheaper version
+ * so the change is not heard.  The cheaper filters are centred on the
+ * same noise as the full one, and during the crossfade both are rendered
+ * from the same noise, so the two are closely correlated and a linear
+ * fade keeps the level.
+ *
+ * Steps down happen at once, since rendering twice would make matters
+ * worse.  Shortening the filter is seamless; the IIR filter is first run
+ * over the recent noise, so it starts where it would have been.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "adapt.h"
+
+/* Step down when rendering takes this share of the block time on
+ * average, or ADAPT_LATE of it in a single block */
+#define ADAPT_HIGH 0.5
+#define ADAPT_LATE 0.9
+
+/* Step up when the load has stayed below this for ADAPT_CALM seconds */
+#define ADAPT_LOW  0.15
+#define ADAPT_CALM 3
+
+/* Stepping down within this many seconds of stepping up doubles the wait
+ * before the next try, up to ADAPT_MAX_CALM seconds */
+#define ADAPT_RELAPSE 10
+#define ADAPT_MAX_CALM 120
+
+/* Weight of each block in the smoothed load */
+#define ADAPT_SMOOTH 0.2
+
+/* Blocks ignored after starting, and after each step */
+#define ADAPT_START  16
+#define ADAPT_SETTLE 4
+
+/* Frames of crossfade after stepping up */
+#define ADAPT_FADE 4096
+
+/* Fewest taps a shortened filter keeps */
+#define ADAPT_MIN_TAPS 3
+
+#define ADAPT_Q M_SQRT1_2
+
+
+
+/* Room needed in the arena by adapt_init() */
+size_t adapt_size(int channels, long frames)
+{
+    return ARENA_SPACE(2 * MAX_FILTER_LEN * sizeof(double)) +
+           ARENA_SPACE(sizeof(fused_gen)) +
+           ARENA_SPACE(frames * channels);
+}
+
+
+
+static long adapt_blocks(adapt_gen* a, int seconds)
+{
+    return (long) seconds * a->rate / a->frames + 1;
+}
+
+
+
+/* Set up for blocks of 'frames' frames of 'channels' channels at 'rate'
+ * Hz, with buffers from 'mem'.  adapt_design() must be called before the
+ * first block is rendered.  Returns -1 on failure. */
+int adapt_init(adapt_gen* a, arena* mem, int channels, long frames, int rate)
+{
+    memset(a, 0, sizeof(adapt_gen));
+    a->channels = channels;
+    a->frames   = frames;
+    a->rate     = rate;
+    if ((a->coeff = (double *) arena_alloc(mem, 2 * MAX_FILTER_LEN * sizeof(double))) == NULL ||
+        (a->spare = (fused_gen *) arena_alloc(mem, sizeof(fused_gen))) == NULL ||
+        (a->fadeBuf = (unsigned char *) arena_alloc(mem, frames * channels)) == NULL)
+    {
+        return -1;
+    }
+    a->settle   = ADAPT_START;
+    a->patience = adapt_blocks(a, ADAPT_CALM);
+    a->sinceUp  = adapt_blocks(a, ADAPT_RELAPSE);
+    a->fadeDone = ADAPT_FADE;
+    return 0;
+}
+
+
+
+static double adapt_gain(const double* filt, int M)
+{
+    double sum = 0.0;
+    int i;
+
+    for (i=0; i<M; i++)
+    {
+        sum += filt[i];
+    }
+    return sum;
+}
+
+
+
+/* Work out the cheaper filters for an 'M'-tap filter of type 'type' with
+ * cutoff 'cutoff', as used at level 0.  Windowed filters are not scaled
+ * to unity gain, and short ones stray far from it, so each is given the
+ * DC gain of the full filter to keep the output centred. */
+void adapt_design(adapt_gen* a, int type, int M, double cutoff)
+{
+    adapt_biquad* b = &a->iir;
+    double* filt;
+    double gain, scale, w0, alpha, a0, delay;
+    int i, k, n;
+
+    a->filterType = type;
+    a->length     = M;
+    a->cutoff     = cutoff;
+
+    /* The full filter, just for its gain */
+    computeFilterCoeff(type, a->coeff, M, cutoff);
+    gain = adapt_gain(a->coeff, M);
+
+    a->levelLength[0] = M;
+    for (k=1; k<ADAPT_IIR; k++)
+    {
+        n = M >> k;
+        n = n < ADAPT_MIN_TAPS ? (M < ADAPT_MIN_TAPS ? M : ADAPT_MIN_TAPS) : n;
+        a->levelLength[k] = n;
+        filt = a->coeff + (k-1) * MAX_FILTER_LEN;
+        computeFilterCoeff(type, filt, n, cutoff);
+        scale = gain / adapt_gain(filt, n);
+        for (i=0; i<n; i++)
+        {
+            filt[i] *= scale;
+        }
+    }
+
+    /* Butterworth section at the same cutoff */
+    w0    = M_PI * cutoff;
+    alpha = sin(w0) / (2.0 * ADAPT_Q);
+    a0    = 1.0 + alpha;
+    b->b0 = gain * (1.0 - cos(w0)) / 2.0 / a0;
+    b->b1 = gain * (1.0 - cos(w0)) / a0;
+    b->b2 = b->b0;
+    b->a1 = -2.0 * cos(w0) / a0;
+    b->a2 = (1.0 - alpha) / a0;
+
+    /* Feed it the noise late enough to line up with the FIR filters,
+     * which are centred (M-1)/2 frames behind the newest */
+    delay = (M-1) / 2.0 - (1.0 - (b->a1 + 2.0 * b->a2) / (1.0 + b->a1 + b->a2));
+    a->delay = delay < 0.0 ? 0 : (int) (delay + 0.5);
+}
+
+
+
+void adapt_set_rate(adapt_gen* a, int rate)
+{
+    a->rate     = rate;
+    a->patience = adapt_blocks(a, ADAPT_CALM);
+}
+
+
+
+/* Run the IIR filter over 'frames' frames of 'in', into 'out' if it is
+ * not NULL */
+static void adapt_iir(adapt_biquad* b, const unsigned char* in, unsigned char* out,
+                      long frames, int C)
+{
+    double x, y;
+    long i;
+    int c;
+
+    for (c=0; c<C; c++)
+    {
+        for (i=0; i<frames; i++)
+        {
+            x = (double) in[i*C + c] - 128.0;
+            y = b->b0 * x + b->z1[c];
+            b->z1[c] = b->b1 * x - b->a1 * y + b->z2[c];
+            b->z2[c] = b->b2 * x - b->a2 * y;
+            if (out != NULL)
+            {
+                y += 128.0;
+                out[i*C + c] = y > 255.0 ? 255 : (y < 0.0 ? 0 : y);
+            }
+        }
+    }
+}
+
+
+
+/* Render a block at quality 'level' */
+static void adapt_level(adapt_gen* a, int level, fused_gen* tiles, noise_gen* noise,
+                        adapt_biquad* iir, unsigned char* out, double* coeff,
+                        double* fade, double step)
+{
+    if (level == 0)
+    {
+        fused_render(tiles, noise, out, a->frames, coeff, a->length, fade, step);
+    }
+    else if (level < ADAPT_IIR)
+    {
+        fused_render_within(tiles, noise, out, a->frames,
+                            a->coeff + (level-1) * MAX_FILTER_LEN, a->levelLength[level],
+                            a->length, fade, step);
+    }
+    else
+    {
+        fused_raw(tiles, noise, out, a->frames, a->delay, fade, step);
+        adapt_iir(iir, out, out, a->frames, a->channels);
+    }
+}
+
+
+
+static void adapt_announce(adapt_gen* a, const char* why)
+{
+    if (a->level == ADAPT_IIR)
+    {
+        printf("%s; filtering with a two-pole IIR lowpass.\n", why);
+    }
+    else if (a->level == 0)
+    {
+        printf("%s; filtering with all %d taps.\n", why, a->length);
+    }
+    else
+    {
+        printf("%s; filtering with %d of %d taps.\n", why, a->levelLength[a->level],
+               a->length);
+    }
+}
+
+
+
+/* Drop a level at once.  The IIR filter is first run over the noise
+ * still in the tiles, so it starts where it would have been. */
+static void adapt_lower(adapt_gen* a, fused_gen* tiles)
+{
+    a->level++;
+    a->lowered[a->level]++;
+    if (a->level == ADAPT_IIR)
+    {
+        memset(a->iir.z1, 0, sizeof(a->iir.z1));
+        memset(a->iir.z2, 0, sizeof(a->iir.z2));
+        adapt_iir(&a->iir, tiles->buffer, NULL, FUSED_HISTORY - a->delay, a->channels);
+    }
+    a->fadeDone = ADAPT_FADE;
+}
+
+
+
+/* Go up a level, crossfading from the one before */
+static void adapt_raise(adapt_gen* a)
+{
+    a->fadeFrom = a->level;
+    a->fadeDone = 0;
+    a->level--;
+    a->sinceUp  = 0;
+}
+
+
+
+/* Judge the load after a block which took 'elapsed' seconds to render */
+static void adapt_judge(adapt_gen* a, fused_gen* tiles, double elapsed)
+{
+    double x = elapsed * a->rate / a->frames;
+    char why[64];
+
+    a->sinceUp++;
+    if (a->pinned)
+    {
+        return;
+    }
+    if (a->settle > 0)
+    {
+        a->settle--;
+        return;
+    }
+    a->load += ADAPT_SMOOTH * (x - a->load);
+
+    if ((a->load > ADAPT_HIGH || x > ADAPT_LATE) && a->level < ADAPT_IIR)
+    {
+        snprintf(why, sizeof(why), "Rendering took %d%% of the block time",
+                 (int) (100.0 * (x > a->load ? x : a->load)));
+        if (a->sinceUp < adapt_blocks(a, ADAPT_RELAPSE))
+        {
+            /* It was too soon; wait longer next time */
+            a->patience *= 2;
+            if (a->patience > adapt_blocks(a, ADAPT_MAX_CALM))
+            {
+                a->patience = adapt_blocks(a, ADAPT_MAX_CALM);
+            }
+        }
+        adapt_lower(a, tiles);
+        adapt_announce(a, why);
+    }
+    else if (a->load < ADAPT_LOW && a->level > 0)
+    {
+        if (++a->calm < a->patience)
+        {
+            return;
+        }
+        adapt_raise(a);
+        adapt_announce(a, "The load has eased");
+    }
+    else
+    {
+        a->calm = 0;
+        return;
+    }
+    a->load   = 0.0;
+    a->calm   = 0;
+    a->settle = ADAPT_SETTLE;
+}
+
+
+
+/* Step to quality 'level' just as a change in the load would, and leave
+ * it there whatever the load.  For the self-test. */
+void adapt_force(adapt_gen* a, fused_gen* tiles, int level)
+{
+    while (a->level < level)
+    {
+        adapt_lower(a, tiles);
+    }
+    while (a->level > level)
+    {
+        adapt_raise(a);
+    }
+    a->pinned = 1;
+}
+
+
+
+/* Render a block of a->frames frames into 'out', at the quality the load
+ * allows.  'coeff' holds the taps of the full filter; 'fade' and 'step'
+ * are as for fused_render(). */
+void adapt_render(adapt_gen* a, fused_gen* tiles, noise_gen* noise, unsigned char* out,
+                  double* coeff, double* fade, double step)
+{
+    struct timespec end;
+    noise_gen fadeNoise;
+    double fadeLevel, t;
+    long i;
+    int c, C = a->channels;
+
+    clock_gettime(CLOCK_MONOTONIC, &a->start);
+
+    if (a->fadeDone < ADAPT_FADE)
+    {
+        /* The level before, from the same noise.  The IIR filter is not
+         * used by the levels above it, so when fading out from it, it
+         * runs on from block to block as before. */
+        *a->spare = *tiles;
+        fadeNoise = *noise;
+        fadeLevel = fade != NULL ? *fade : 0.0;
+        adapt_level(a, a->fadeFrom, a->spare, &fadeNoise, &a->iir, a->fadeBuf, coeff,
+                    fade != NULL ? &fadeLevel : NULL, step);
+    }
+    adapt_level(a, a->level, tiles, noise, &a->iir, out, coeff, fade, step);
+
+    if (a->fadeDone < ADAPT_FADE)
+    {
+        for (i=0; i<a->frames; i++)
+        {
+            t = (double) (a->fadeDone + i) / ADAPT_FADE;
+            t = t > 1.0 ? 1.0 : t;
+            for (c=0; c<C; c++)
+            {
+                out[i*C + c] = (1.0 - t) * a->fadeBuf[i*C + c] + t * out[i*C + c] + 0.5;
+            }
+        }
+        a->fadeDone += a->frames;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    adapt_judge(a, tiles, (end.tv_sec - a->start.tv_sec) +
+                          (end.tv_nsec - a->start.tv_nsec) * 1e-9);
+}
+
+
+
+/* Say how often the quality had to be lowered, if at all */
+void adapt_report(adapt_gen* a)
+{
+    long total = 0;
+    int k;
+
+    for (k=1; k<ADAPT_LEVELS; k++)
+    {
+        total += a->lowered[k];
+    }
+    if (total > 0)
+    {
+        printf("Filter quality was lowered %ld time%s: %ld to half the taps, "
+               "%ld to a quarter, %ld to the IIR lowpass.\n", total, total == 1 ? "" : "s",
+               a->lowered[1], a->lowered[2], a->lowered[ADAPT_IIR]);
+    }
+}
+
+
+/* arch-tag: adaptive filter quality */
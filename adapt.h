@@ -0,0 +1,94 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef ADAPT_H
+#define ADAPT_H 1
+
+#include <stddef.h>
+#include <time.h>
+#include "arena.h"
+#include "filter.h"
+#include "fused.h"
+#include "noise.h"
+
+/* Quality levels: the full filter, half and a quarter of its taps, and a
+ * two-pole IIR lowpass */
+#define ADAPT_LEVELS 4
+#define ADAPT_IIR    (ADAPT_LEVELS - 1)
+
+
+/* Second-order lowpass section, run on samples centred on zero */
+typedef struct
+{
+    double b0, b1, b2, a1, a2;
+    double z1[MAX_CHANNELS];
+    double z2[MAX_CHANNELS];
+} adapt_biquad;
+
+
+/* Lowers the filter quality when blocks take too long to render, and
+ * raises it again once the load eases */
+typedef struct
+{
+    int channels;
+    int rate;
+    long frames;            /* per block */
+
+    /* Filter asked for, of which the levels are cheaper versions */
+    int filterType;
+    int length;
+    double cutoff;
+
+    int level;
+    int levelLength[ADAPT_IIR];     /* taps at each FIR level */
+    double* coeff;          /* taps of levels 1 and 2, MAX_FILTER_LEN apart */
+    adapt_biquad iir;
+    int delay;              /* frames the IIR filter runs behind the newest */
+
+    double load;            /* smoothed render time over block time */
+    int settle;             /* blocks before the load is judged again */
+    int calm;               /* blocks in a row with the load low */
+    int patience;           /* calm blocks needed before stepping up */
+    long sinceUp;           /* blocks since the last step up */
+    long lowered[ADAPT_LEVELS];     /* times each level was dropped to */
+    int pinned;             /* set by adapt_force() */
+
+    /* Crossfade from the level before stepping up */
+    int fadeFrom;
+    long fadeDone;
+    fused_gen* spare;
+    unsigned char* fadeBuf;
+
+    struct timespec start;
+} adapt_gen;
+
+
+size_t adapt_size( int, long );
+int  adapt_init( adapt_gen*, arena*, int, long, int );
+void adapt_design( adapt_gen*, int, int, double );
+void adapt_set_rate( adapt_gen*, int );
+void adapt_force( adapt_gen*, fused_gen*, int );
+void adapt_render( adapt_gen*, fused_gen*, noise_gen*, unsigned char*, double*,
+                   double*, double );
+void adapt_report( adapt_gen* );
+
+
+#endif
+
+
+/* arch-tag: adaptive filter quality (header) */
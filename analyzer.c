@@ -0,0 +1,300 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* analyzer.c
+ * Measures the spectrum of the noise actually sent to the sound card,
+ * after clamping and quantization.  The audio thread copies part of its
+ * output into a lock-free ring; a worker thread picks it up and keeps a
+ * running Welch estimate of the power spectral density.
+ */
+
+#include "analyzer.h"
+
+#ifdef HAS_FFTW3
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "fft.h"
+#include "userdir.h"
+#include "rt.h"
+
+
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+/* How often the worker looks for new samples, in milliseconds */
+#define ANALYZER_POLL 50
+
+
+static void analyzer_segment(analyzer* an, const unsigned char* x)
+{
+    int i;
+    double a, b, p;
+    double weight;
+
+    for (i=0; i<FFT_SIZE; i++)
+    {
+        an->fft_in[i] = an->window[i] * (((double) x[i] - 128.0) / 128.0);
+    }
+    fftw_execute(an->plan);
+
+    an->segments++;
+    weight = 1.0 / (double) MIN(an->segments, ANALYZER_AVERAGE);
+    for (i=0; i<FFT_SIZE/2 + 1; i++)
+    {
+        a = an->fft_out[i][0];
+        b = an->fft_out[i][1];
+        p = a*a + b*b;
+        an->psd[i] += weight * (p - an->psd[i]);
+    }
+}
+
+
+/* Write the current estimate as "frequency  dB/Hz" pairs, relative to a
+ * full-scale signal. */
+static void analyzer_write(analyzer* an)
+{
+    char* path;
+    char* tmp_path = NULL;
+    FILE* f;
+    int i, err;
+    double scale, f_hz, p;
+
+    if ((path = userdir_path(SPECTRUM_NAME)) == NULL ||
+        (tmp_path = (char *) malloc(strlen(path) + 5)) == NULL)
+    {
+        free(path);
+        return;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+
+    if ((f = fopen(tmp_path, "w")) == NULL)
+    {
+        fprintf(stderr, "Could not open \"~/.whitenoise/%s\" for writing.\n", SPECTRUM_NAME);
+        goto cleanup;
+    }
+
+    /* one-sided density, corrected for the window's power */
+    scale = 2.0 / ((double) an->psdRate * an->windowPower);
+    fprintf(f, "# %ld segments\n", an->segments);
+    for (i=0; i<FFT_SIZE/2 + 1; i++)
+    {
+        f_hz = ((double) an->psdRate * (double) i) / (double) FFT_SIZE;
+        p = an->psd[i] * scale;
+        if (p > 0.0)
+        {
+            fprintf(f, "%g     %g\n", f_hz, 10.0*log10(p));
+        }
+    }
+    err = ferror(f);
+    if ((fclose(f) != 0) || err || rename(tmp_path, path) < 0)
+    {
+        fprintf(stderr, "Could not write \"~/.whitenoise/%s\".\n", SPECTRUM_NAME);
+        remove(tmp_path);
+    }
+
+cleanup:
+    free(path);
+    free(tmp_path);
+}
+
+
+static void* analyzer_worker(void* arg)
+{
+    analyzer* an = (analyzer *) arg;
+    unsigned char run[ANALYZER_RUN];
+    struct timespec poll = { 0, ANALYZER_POLL * 1000000L };
+    time_t nextDump = time(NULL) + an->dumpInterval;
+    int i, rate;
+
+    rt_demote();
+
+    for (i=0; i<FFT_SIZE; i++)
+    {
+        an->window[i] = 0.5 - 0.5*cos(2.0*M_PI*i/FFT_SIZE);
+        an->windowPower += an->window[i] * an->window[i];
+    }
+
+    if ((an->fft_in = (double *) fftw_malloc(FFT_SIZE * sizeof(double))) == NULL ||
+        (an->fft_out = (fftw_complex *) fftw_malloc((FFT_SIZE/2 + 1) * sizeof(fftw_complex))) == NULL ||
+        (an->plan = fft_plan_r2c(FFT_SIZE, an->fft_in, an->fft_out)) == NULL)
+    {
+        fprintf(stderr, "Error: could not set up FFT for the spectrum analyzer.\n");
+        return NULL;
+    }
+
+    while (atomic_load(&an->running))
+    {
+        /* Start over whenever the frequency axis changes */
+        rate = atomic_load(&an->rate);
+        if (rate != an->psdRate)
+        {
+            memset(an->psd, 0, sizeof(an->psd));
+            an->segments = 0;
+            an->psdRate  = rate;
+        }
+
+        while (ring_fill(&an->tap) >= ANALYZER_RUN)
+        {
+            ring_read(&an->tap, run, ANALYZER_RUN);
+            for (i=0; i + FFT_SIZE <= ANALYZER_RUN; i += FFT_SIZE/2)
+            {
+                analyzer_segment(an, run + i);
+            }
+        }
+
+        if (atomic_exchange(&an->dumpRequested, 0) ||
+            (an->dumpInterval > 0 && time(NULL) >= nextDump))
+        {
+            analyzer_write(an);
+            nextDump = time(NULL) + an->dumpInterval;
+        }
+
+        nanosleep(&poll, NULL);
+    }
+
+    return NULL;
+}
+
+
+
+/* Start analyzing.  If 'dumpInterval' is positive, the spectrum is
+ * written out every 'dumpInterval' seconds as well as on request. */
+int analyzer_init(analyzer* an, int rate, int dumpInterval)
+{
+    memset(an, 0, sizeof(analyzer));
+    if (ring_init(&an->tap, ANALYZER_RING) < 0)
+    {
+        return -1;
+    }
+    atomic_init(&an->running, 1);
+    atomic_init(&an->dumpRequested, 0);
+    atomic_init(&an->rate, rate);
+    an->dumpInterval = dumpInterval;
+
+    if (pthread_create(&an->thread, NULL, analyzer_worker, an) != 0)
+    {
+        ring_exit(&an->tap);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+void analyzer_exit(analyzer* an)
+{
+    atomic_store(&an->running, 0);
+    pthread_join(an->thread, NULL);
+
+    if (an->plan != NULL) fft_destroy_plan(an->plan);
+    if (an->fft_in != NULL) fftw_free(an->fft_in);
+    if (an->fft_out != NULL) fftw_free(an->fft_out);
+    ring_exit(&an->tap);
+}
+
+
+
+/* Copy 'n' frames of the first channel into the tap */
+static void analyzer_gather(analyzer* an, const unsigned char* block, int n,
+        int channels)
+{
+    unsigned char buf[256];
+    int i, k;
+
+    if (channels == 1)
+    {
+        ring_write(&an->tap, block, n);
+        return;
+    }
+    while (n > 0)
+    {
+        k = MIN(n, (int) sizeof(buf));
+        for (i=0; i<k; i++)
+        {
+            buf[i] = block[i*channels];
+        }
+        ring_write(&an->tap, buf, k);
+        block += k*channels;
+        n -= k;
+    }
+}
+
+
+
+/* Hand a block of 'n' output frames to the analyzer; only the first
+ * channel is analyzed.  Called from the audio thread; never blocks.  If
+ * the worker has fallen behind, whole runs are dropped so that every run
+ * it sees is contiguous. */
+void analyzer_tap(analyzer* an, const unsigned char* block, int n, int channels)
+{
+    int k;
+
+    while (n > 0)
+    {
+        if (an->skip > 0)
+        {
+            k = MIN(an->skip, n);
+            an->skip -= k;
+        }
+        else
+        {
+            if (an->runLeft == 0)
+            {
+                if (ring_space(&an->tap) < ANALYZER_RUN)
+                {
+                    an->skip = ANALYZER_RUN;
+                    continue;
+                }
+                an->runLeft = ANALYZER_RUN;
+            }
+            k = MIN(an->runLeft, n);
+            analyzer_gather(an, block, k, channels);
+            an->runLeft -= k;
+            if (an->runLeft == 0)
+            {
+                an->skip = ANALYZER_SKIP;
+            }
+        }
+        block += k*channels;
+        n -= k;
+    }
+}
+
+
+
+/* Ask for the spectrum to be written out, from any thread */
+void analyzer_dump(analyzer* an)
+{
+    atomic_store(&an->dumpRequested, 1);
+}
+
+
+
+void analyzer_set_rate(analyzer* an, int rate)
+{
+    atomic_store(&an->rate, rate);
+}
+
+#endif /* HAS_FFTW3 */
+
+
+/* arch-tag: live spectrum analyzer */
@@ -0,0 +1,80 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef ANALYZER_H
+#define ANALYZER_H 1
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAS_FFTW3
+#include <fftw3.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "plot.h"
+#include "ring.h"
+
+#define SPECTRUM_NAME     "spectrum-data"
+
+/* The output is tapped in contiguous runs of ANALYZER_RUN samples, each
+ * followed by ANALYZER_SKIP samples which are not analyzed. */
+#define ANALYZER_RUN      (FFT_SIZE * 2)
+#define ANALYZER_SKIP     (FFT_SIZE * 6)
+#define ANALYZER_RING     (1 << 16)
+
+/* Segments are averaged over roughly this many of the most recent */
+#define ANALYZER_AVERAGE  64
+
+
+typedef struct
+{
+    ring tap;
+    pthread_t thread;
+    atomic_int running;
+    atomic_int dumpRequested;
+    atomic_int rate;
+    int dumpInterval;
+
+    /* Tap state, owned by the audio thread */
+    long skip;
+    long runLeft;
+
+    /* Owned by the worker */
+    double* fft_in;
+    fftw_complex* fft_out;
+    fftw_plan plan;
+    double window[FFT_SIZE];
+    double windowPower;
+    double psd[FFT_SIZE/2 + 1];
+    long segments;
+    int psdRate;
+} analyzer;
+
+int  analyzer_init( analyzer*, int, int );
+void analyzer_exit( analyzer* );
+void analyzer_tap( analyzer*, const unsigned char*, int, int );
+void analyzer_dump( analyzer* );
+void analyzer_set_rate( analyzer*, int );
+#endif
+
+
+#endif
+
+
+/* arch-tag: live spectrum analyzer (header) */
@@ -0,0 +1,152 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* arena.c
+ * One block of memory for all the buffers of the audio path, set up
+ * before playback starts.  Buffers are carved from it in turn and never
+ * freed, so that once playing, the audio path makes no heap calls.  The
+ * whole block is faulted in at once, and may be backed by huge pages, so
+ * that it all sits under one TLB entry.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+
+
+/* Huge pages reserved by the administrator, or failing that transparent
+ * ones, in an aligned stretch of normal memory.  Returns MAP_FAILED if
+ * neither is possible. */
+static void* arena_map_huge(size_t size)
+{
+    unsigned char* p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    p = (unsigned char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        printf("Audio buffers: %zu kB in huge pages.\n", size / 1024);
+        return p;
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    {
+        unsigned char* start;
+        size_t head;
+
+        p = (unsigned char *) mmap(NULL, size + ARENA_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            return p;
+        }
+        /* Trim to a huge page boundary at both ends */
+        start = (unsigned char *) (((uintptr_t) p + ARENA_HUGE_PAGE - 1) &
+                                   ~(uintptr_t) (ARENA_HUGE_PAGE - 1));
+        head  = start - p;
+        if (head > 0)
+        {
+            munmap(p, head);
+        }
+        munmap(start + size, ARENA_HUGE_PAGE - head);
+
+        if (madvise(start, size, MADV_HUGEPAGE) == 0)
+        {
+            printf("Audio buffers: %zu kB in transparent huge pages.\n",
+                    size / 1024);
+            return start;
+        }
+        munmap(start, size);
+    }
+#endif
+    return MAP_FAILED;
+}
+
+
+
+/* Set up an arena of at least 'size' bytes, in huge pages if 'huge' is
+ * set and the system allows.  Returns -1 on failure. */
+int arena_init(arena* a, size_t size, int huge)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    void* p = MAP_FAILED;
+
+    memset(a, 0, sizeof(arena));
+    if (huge)
+    {
+        a->size = (size + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+        if ((p = arena_map_huge(a->size)) == MAP_FAILED)
+        {
+            printf("Audio buffers: no huge pages available; using normal pages.\n");
+        }
+    }
+    if (p == MAP_FAILED)
+    {
+        a->size = (size + page - 1) / page * page;
+        p = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (p == MAP_FAILED)
+    {
+        a->size = 0;
+        return -1;
+    }
+
+    /* Fault it all in now, rather than in the middle of a block */
+    a->base = (unsigned char *) p;
+    memset(a->base, 0, a->size);
+    return 0;
+}
+
+
+
+/* A zeroed buffer of 'size' bytes, aligned to ARENA_ALIGN, or NULL if the
+ * arena is full */
+void* arena_alloc(arena* a, size_t size)
+{
+    void* p;
+
+    size = ARENA_SPACE(size);
+    if (a->base == NULL || size > a->size - a->used)
+    {
+        return NULL;
+    }
+    p = a->base + a->used;
+    a->used += size;
+    return p;
+}
+
+
+
+void arena_exit(arena* a)
+{
+    if (a->base != NULL)
+    {
+        munmap(a->base, a->size);
+    }
+    memset(a, 0, sizeof(arena));
+}
+
+
+/* arch-tag: audio buffer arena */
@@ -0,0 +1,49 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stddef.h>
+
+/* Every buffer starts on a cache line, which covers any SIMD alignment */
+#define ARENA_ALIGN 64
+
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+/* Room taken by a buffer of 'n' bytes */
+#define ARENA_SPACE(n) (((size_t) (n) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+
+typedef struct
+{
+    unsigned char* base;
+    size_t size;
+    size_t used;
+} arena;
+
+
+int   arena_init( arena*, size_t, int );
+void* arena_alloc( arena*, size_t );
+void  arena_exit( arena* );
+
+
+#endif
+
+
+/* arch-tag: audio buffer arena (header) */
@@ -19,156 +19,395 @@
 
 /* audio.c
  * a wrapper which abstracts the audio-related library calls away from the
- * underlying implementations.
+ * underlying implementations.  Each output lives in its own audio_*.c
+ * file, behind an audio_backend table.
  */
 
-#include <sys/soundcard.h>
-#include <sys/ioctl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
 #include <errno.h>
-#include <math.h>
 #include "audio.h"
 
 
-/* initialize ALSA */
-static void alsa_init(audio_dev_handle* handle)
+const audio_backend* audio_backends[] =
 {
-    int err;
+#ifdef HAS_ALSA
+    &alsa_backend,
+#endif
+#ifdef HAS_PULSE
+    &pulse_backend,
+#endif
+#ifdef HAS_JACK
+    &jack_backend,
+#endif
+    &file_backend,
+    &shm_backend,
+    &stdout_backend,
+    &null_backend,
+    NULL
+};
+
+
 
-    /* Set up the sound card */
-    if ( (err = snd_pcm_open(&handle->alsa_handle, "default", SND_PCM_STREAM_PLAYBACK, 0)) < 0 )
+/* Open the output named by 'output', which has the form NAME[:ARG].  A
+ * NULL output selects the default backend. */
+int audio_init(audio_dev_handle* handle, const char* output, int rate, int latency, int channels)
+{
+    const audio_backend** b;
+    const char* arg = NULL;
+    size_t len;
+
+    memset(handle, 0, sizeof(audio_dev_handle));
+    handle->channels = channels;
+    handle->rate     = rate;
+    handle->latency  = latency; /* in ms */
+
+    if (output == NULL)
     {
-        printf("snd_pcm_open failed: %s\n", snd_strerror(err));
-        exit(EXIT_FAILURE);
+        handle->backend = audio_backends[0];
     }
+    else
+    {
+        if ((arg = strchr(output, ':')) != NULL)
+        {
+            len = arg - output;
+            arg++;
+        }
+        else
+        {
+            len = strlen(output);
+        }
 
-    if ( (err = snd_pcm_set_params(handle->alsa_handle,
-                                   handle->format,
-                                   SND_PCM_ACCESS_RW_INTERLEAVED,
-                                   handle->channels,
-                                   handle->rate,
-                                   1, /* allow resampling */
-                                   handle->latency * 1000)) < 0) {
-        printf("snd_pcm_set_params failed: %s\n", snd_strerror(err));
-	exit(EXIT_FAILURE);
+        for (b = audio_backends; *b != NULL; b++)
+        {
+            if (strlen((*b)->name) == len && strncmp((*b)->name, output, len) == 0)
+            {
+                handle->backend = *b;
+                break;
+            }
+        }
+        if (handle->backend == NULL)
+        {
+            fprintf(stderr, "Error: unknown output \"%s\".\n", output);
+            return -1;
+        }
+    }
+    handle->device = (arg != NULL && *arg != '\0') ? arg : NULL;
+
+    if (handle->backend->open(handle) < 0)
+    {
+        handle->backend = NULL;
+        return -1;
     }
+    return 0;
 }
 
 
-/* initialize the sound card or connect to aRts server */
-void audio_init(audio_dev_handle* handle, int rate, int latency, int try_arts)
+
+void audio_exit(audio_dev_handle* handle)
 {
-#ifdef HAS_ARTS
-    int artserr = 0;
+    if (handle->backend != NULL)
+    {
+        handle->backend->close(handle);
+        handle->backend = NULL;
+    }
+}
+
+
+
+/* send audio to the output.  'size' is in frames of 'channels' samples.
+ * Blocks until all of it has been accepted; returns -1 if the output
+ * has failed. */
+int audio_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    if (handle->backend == NULL)
+    {
+        return -1;
+    }
+    if (handle->backend->write(handle, buffer, size) < 0)
+    {
+        return -1;
+    }
+    handle->written += (double) size / handle->rate;
+    if (handle->buffer == 0)
+    {
+        audio_started(handle);
+    }
+    return 0;
+}
 
-    handle->arts_handle = NULL;
-    handle->use_arts    = 0;
-#endif
-    handle->alsa_handle = NULL;
-    handle->channels    = 1;  /* mono */
-    handle->format      = SND_PCM_FORMAT_U8;
-    handle->rate        = rate;
-    handle->latency     = latency; /* in ms */
 
-#ifdef HAS_ARTS    
-    if( try_arts )
+
+/* Called by the output when playback begins, with the pre-roll still
+ * queued.  Only the first start is recorded; restarts after an underrun
+ * or a reconfiguration are not. */
+void audio_started(audio_dev_handle* handle)
+{
+    if (handle->started)
+    {
+        return;
+    }
+    handle->started = 1;
+    clock_gettime(CLOCK_MONOTONIC, &handle->startTime);
+    if ((handle->preroll = handle->backend->delay(handle)) < 0)
     {
-        artserr = arts_init();
-        if( artserr < 0 )
+        handle->preroll = 0;
+    }
+}
+
+
+
+void audio_clock_init(audio_dev_handle* handle, audio_clock* vc)
+{
+    vc->queued = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &vc->last);
+    handle->buffer = (long) handle->latency * handle->rate / 1000;
+}
+
+
+
+/* Drain the virtual buffer up to the present, and return what is left */
+long audio_clock_delay(audio_dev_handle* handle, audio_clock* vc)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (handle->started && vc->queued > 0.0)
+    {
+        vc->queued -= ((double) (now.tv_sec - vc->last.tv_sec) +
+                       (double) (now.tv_nsec - vc->last.tv_nsec) * 1e-9) * handle->rate;
+        if (vc->queued < 0.0)
         {
-            fprintf(stderr, "Error initializing aRts: %s\n", arts_error_text(artserr));
-            exit(-1);
+            handle->xruns++;
+            vc->queued = 0.0;
         }
-        handle->arts_handle = arts_play_stream( *rate, 8, handle->channels, "arts-whitenoise" );
-        arts_stream_set(handle->arts_handle, ARTS_P_BUFFER_TIME, *latency);
-        handle->use_arts = 1;
     }
-    else
-#endif
+    vc->last = now;
+    return (long) vc->queued;
+}
+
+
+
+/* Block until the buffer has room for 'size' frames, as a sound card
+ * would, and queue them.  The first write that would overfill it starts
+ * playback. */
+void audio_clock_write(audio_dev_handle* handle, audio_clock* vc, int size)
+{
+    double limit, wait;
+    struct timespec ts;
+
+    limit = (double) handle->latency * handle->rate / 1000.0;
+    audio_clock_delay(handle, vc);
+    if (!handle->started && vc->queued + size > limit)
+    {
+        audio_started(handle);
+    }
+    wait = (vc->queued + size - limit) / handle->rate;
+    if (wait > 0.0 && handle->wake > size)
     {
-        alsa_init(handle);
+        /* Hold off until there is room for a whole burst */
+        wait = (vc->queued + handle->wake - limit) / handle->rate;
     }
+    if (wait > 0.0)
+    {
+        ts.tv_sec  = (time_t) wait;
+        ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        audio_clock_delay(handle, vc);
+    }
+    vc->queued += size;
 }
 
 
 
-/* close sound device or disconnect from aRts server */
-void audio_exit(audio_dev_handle* handle)
+/* Let the output sleep until it has room for 'frames' frames, rather
+ * than waking as soon as there is room for a block, so that the main
+ * loop refills it in bursts.  'frames' must be less than the buffer, and
+ * 0 restores the default.  Outputs which cannot hold off ignore it. */
+void audio_set_wakeup(audio_dev_handle* handle, long frames)
 {
-#ifdef HAS_ARTS
-    if(handle->use_arts)
+    handle->wake = frames;
+}
+
+
+
+/* Block until everything written has been heard, or the output stops
+ * draining.  A signal cuts the wait short. */
+void audio_drain(audio_dev_handle* handle)
+{
+    long delay, last = -1, xruns = handle->xruns;
+    double wait;
+    struct timespec ts;
+
+    if (handle->backend == NULL)
     {
-        arts_close_stream(handle->arts_handle);
-        arts_free();
+        return;
     }
-    else
-#endif
+    if (handle->backend->start != NULL)
+    {
+        handle->backend->start(handle);
+    }
+    audio_started(handle);
+    while ((delay = handle->backend->delay(handle)) > 0)
     {
-        snd_pcm_close(handle->alsa_handle);
+        if (last >= 0 && delay >= last)
+        {
+            /* Whatever is left is latency beyond our reach */
+            break;
+        }
+        last = delay;
+        wait = (double) delay / handle->rate + 0.001;
+        ts.tv_sec  = (time_t) wait;
+        ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+        if (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL) != 0)
+        {
+            break;
+        }
     }
+    /* Running dry at the end is no underrun */
+    handle->xruns = xruns;
 }
 
 
 
-/* send audio to soundcard */
-void audio_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+/* Where to render the next 'size' frames so that the output can take
+ * them without a copy, or NULL to use any buffer */
+unsigned char* audio_buffer(audio_dev_handle* handle, int size)
 {
-#ifdef HAS_ARTS
-    if(handle->use_arts)
+    if (handle->backend == NULL || handle->backend->buffer == NULL)
     {
-        arts_write(handle->arts_handle, buffer, size);
+        return NULL;
     }
-    else
-#endif
+    return handle->backend->buffer(handle, size);
+}
+
+
+
+/* Number of frames written but not yet heard, or -1 if unknown */
+long audio_delay(audio_dev_handle* handle)
+{
+    if (handle->backend == NULL)
     {
-        snd_pcm_writei(handle->alsa_handle, buffer, size);
+        return -1;
     }
+    return handle->backend->delay(handle);
 }
 
 
 
-/* close the sound device and reopen with the requested rate */
-void audio_set_rate(audio_dev_handle* handle, int rate)
+/* Sleep until the output has room for 'frames' frames, or descriptor
+ * 'fd' (if not negative) becomes readable, whichever comes first.
+ * Returns AUDIO_WRITABLE and/or AUDIO_INPUT, 0 if interrupted by a
+ * signal, or -1 if the output has failed.  Outputs which cannot be
+ * polled always count as writable; their writes do the waiting. */
+int audio_wait(audio_dev_handle* handle, int fd, long frames)
 {
-    handle->rate = rate;
-#ifdef HAS_ARTS
-    if( handle->use_arts )
+    const audio_backend* b = handle->backend;
+    struct pollfd fds[1 + AUDIO_MAX_FDS];
+    long room;
+    int n, result;
+
+    if (b == NULL)
     {
-        arts_close_stream(handle->arts_handle);
-        handle->arts_handle = arts_play_stream(rate, 8, handle->channels+1, "arts-whitenoise");
+        return -1;
     }
-    else
-#endif
+
+    fds[0].fd     = fd;     /* ignored by poll() if negative */
+    fds[0].events = POLLIN;
+
+    for (;;)
     {
-        snd_pcm_close(handle->alsa_handle);
-        alsa_init(handle);
+        room = frames;
+        if (b->avail != NULL && (room = b->avail(handle)) < 0)
+        {
+            return -1;
+        }
+
+        if (room >= frames)
+        {
+            if (fd < 0)
+            {
+                return AUDIO_WRITABLE;
+            }
+            /* With room already, just check for input */
+            n = 0;
+            if (poll(fds, 1, 0) < 0)
+            {
+                return errno == EINTR ? 0 : -1;
+            }
+        }
+        else
+        {
+            n = b->poll_fds(handle, fds + 1, AUDIO_MAX_FDS);
+            if (poll(fds, 1 + n, -1) < 0)
+            {
+                return errno == EINTR ? 0 : -1;
+            }
+        }
+
+        result = 0;
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            result |= AUDIO_INPUT;
+        }
+        if (room >= frames)
+        {
+            result |= AUDIO_WRITABLE;
+        }
+        else if (n > 0 && (b->revents(handle, fds + 1, n) & (POLLOUT | POLLERR)))
+        {
+            /* Woken by the output; avail() decides whether there is
+             * really enough room, and recovers from any error */
+            continue;
+        }
+
+        if (result != 0)
+        {
+            return result;
+        }
     }
 }
 
 
 
-/* configure the audio buffer sizes.  The latency parameter is in millisec. */
-void audio_set_latency(audio_dev_handle* handle, int latency)
+/* If the output cannot be reopened, it is left closed and every later
+ * write fails */
+static int audio_reopen(audio_dev_handle* handle)
 {
-    handle->latency = latency;
-#ifdef HAS_ARTS
-    if(handle->use_arts)
+    if (handle->backend == NULL)
     {
-        arts_close_stream(handle->arts_handle);
-        handle->arts_handle = arts_play_stream(handle->rate, 8, handle->channels+1, "arts-whitenoise");
-        arts_stream_set(handle->arts_handle, ARTS_P_BUFFER_TIME, latency);
+        return -1;
     }
-    else
-#endif
+    if (handle->backend->reconfigure != NULL)
+    {
+        return handle->backend->reconfigure(handle);
+    }
+    handle->backend->close(handle);
+    if (handle->backend->open(handle) < 0)
     {
-        snd_pcm_close(handle->alsa_handle);
-        alsa_init(handle);
+        handle->backend = NULL;
+        return -1;
     }
+    return 0;
+}
+
+
+
+/* reconfigure the output for the requested rate */
+int audio_set_rate(audio_dev_handle* handle, int rate)
+{
+    handle->rate = rate;
+    return audio_reopen(handle);
+}
+
+
+
+/* configure the audio buffer sizes.  The latency parameter is in millisec. */
+int audio_set_latency(audio_dev_handle* handle, int latency)
+{
+    handle->latency = latency;
+    return audio_reopen(handle);
 }
 
 /* arch-tag: DO_NOT_CHANGE_83580ce5-5d4c-4c21-9852-d05141de6afa */
@@ -16,37 +16,139 @@
     Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#ifndef AUDIO_H
+#define AUDIO_H 1
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#ifdef HAS_ARTS
-#include <artsc.h>
-#endif
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+
+/* Most descriptors an output may ask audio_wait() to poll */
+#define AUDIO_MAX_FDS 16
+
+/* Size of a WAV header, and the data size to give when it is not known */
+#define WAV_HEADER_SIZE  44
+#define WAV_UNKNOWN_SIZE (UINT32_MAX - WAV_HEADER_SIZE)
+
+/* audio_wait() results */
+#define AUDIO_WRITABLE 1
+#define AUDIO_INPUT    2
+
 
-#include <alsa/asoundlib.h>
+typedef struct audio_dev_handle audio_dev_handle;
 
-typedef struct 
+/* One way of getting samples out of the program.  All samples are
+ * unsigned 8-bit and interleaved; sizes are in frames.  'open' reads the
+ * rate, channels, latency and device from the handle, and returns -1 on
+ * failure after reporting why.  'reconfigure' is called after the rate
+ * or latency has changed; if it is NULL the device is closed and opened
+ * again.
+ *
+ * Outputs which can be waited on also provide 'poll_fds', to fill in
+ * their descriptors; 'revents', to translate what poll() returned into
+ * POLLOUT or POLLERR; and 'avail', the number of frames which can be
+ * written without blocking (or -1 if the output has failed).  The rest
+ * leave them NULL, and their writes block instead.
+ *
+ * Outputs which can take samples without copying them provide 'buffer',
+ * which returns where the next block of the given size should be
+ * rendered, ready to be passed to 'write'; or NULL if it cannot be.
+ *
+ * Outputs with a buffer of their own set 'buffer' when opened, fill it
+ * completely before playback starts, and call audio_started() at that
+ * moment.  The rest count as started at the first write.  Outputs which
+ * must be told to start provide 'start', so that a buffer which never
+ * filled can still be played out.  Outputs which take samples as fast as
+ * they are written, such as files, set 'unpaced'.  Underruns are added
+ * to 'xruns' as they are noticed. */
+typedef struct
 {
-    snd_pcm_t* alsa_handle;
-    int latency;
+    const char* name;
+    const char* usage;
+    const char* help;
+    int  (*open)( audio_dev_handle* );
+    int  (*write)( audio_dev_handle*, unsigned char*, int );
+    long (*delay)( audio_dev_handle* );
+    int  (*reconfigure)( audio_dev_handle* );
+    void (*close)( audio_dev_handle* );
+    int  (*poll_fds)( audio_dev_handle*, struct pollfd*, int );
+    unsigned short (*revents)( audio_dev_handle*, struct pollfd*, int );
+    long (*avail)( audio_dev_handle* );
+    unsigned char* (*buffer)( audio_dev_handle*, int );
+    void (*start)( audio_dev_handle* );
+} audio_backend;
+
+struct audio_dev_handle
+{
+    const audio_backend* backend;
+    const char* device;     /* backend argument, or NULL */
+    void* priv;             /* owned by the backend */
+    int latency;            /* in ms */
     int channels;
-    int format;
     int rate;
-#ifdef HAS_ARTS
-    arts_stream_t arts_handle;
-    int use_arts;
+
+    long buffer;            /* frames the output holds, or 0 if unknown */
+    int started;            /* playback has begun */
+    struct timespec startTime;  /* when, by CLOCK_MONOTONIC */
+    long preroll;           /* frames queued at that moment */
+    long xruns;             /* underruns since audio_init() */
+    double written;         /* seconds of audio written */
+    long wake;              /* room to sleep until; see audio_set_wakeup() */
+    int unpaced;            /* takes samples as fast as they come */
+};
+
+
+/* A virtual sound card buffer of 'latency' milliseconds, for outputs
+ * which have to pace themselves.  It fills, starts, then drains at the
+ * sample rate. */
+typedef struct
+{
+    double queued;          /* frames not yet "played" */
+    struct timespec last;   /* when 'queued' was last brought up to date */
+} audio_clock;
+
+
+/* All compiled-in backends, NULL-terminated.  The first is the default. */
+extern const audio_backend* audio_backends[];
+
+#ifdef HAS_ALSA
+extern const audio_backend alsa_backend;
+#endif
+#ifdef HAS_PULSE
+extern const audio_backend pulse_backend;
 #endif
-} audio_dev_handle;
+#ifdef HAS_JACK
+extern const audio_backend jack_backend;
+#endif
+extern const audio_backend file_backend;
+extern const audio_backend shm_backend;
+extern const audio_backend stdout_backend;
+extern const audio_backend null_backend;
 
 
-void audio_init(audio_dev_handle* handle, int rate, int latency, int try_arts);
+int  audio_init(audio_dev_handle* handle, const char* output, int rate, int latency, int channels);
 void audio_exit(audio_dev_handle* handle);
-void audio_write(audio_dev_handle* handle, unsigned char* buffer, int size);
-void audio_set_rate(audio_dev_handle* handle, int rate);
-void audio_set_latency(audio_dev_handle* handle, int latency);
+int  audio_write(audio_dev_handle* handle, unsigned char* buffer, int size);
+long audio_delay(audio_dev_handle* handle);
+unsigned char* audio_buffer(audio_dev_handle* handle, int size);
+int  audio_wait(audio_dev_handle* handle, int fd, long frames);
+int  audio_set_rate(audio_dev_handle* handle, int rate);
+int  audio_set_latency(audio_dev_handle* handle, int latency);
+void audio_started(audio_dev_handle* handle);
+void audio_set_wakeup(audio_dev_handle* handle, long frames);
+void audio_drain(audio_dev_handle* handle);
+
+void audio_clock_init(audio_dev_handle* handle, audio_clock* vc);
+long audio_clock_delay(audio_dev_handle* handle, audio_clock* vc);
+void audio_clock_write(audio_dev_handle* handle, audio_clock* vc, int size);
+void audio_wav_header(unsigned char* h, int rate, int channels, uint32_t bytes);
 
 
+#endif
+
 
 /* arch-tag: DO_NOT_CHANGE_30c6cd8d-e90e-4ec5-b26c-59f3b8ab1a63 */
@@ -0,0 +1,314 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_alsa.c
+ * ALSA output.  Hardware devices are written through mmap access, so the
+ * samples go straight into the DMA buffer; devices which only support
+ * read/write access (most plugins) fall back to snd_pcm_writei().
+ *
+ * The PCM is non-blocking.  The main loop polls its descriptors along
+ * with its own, through audio_wait(), and only writes once there is
+ * room; a write which would still block waits in snd_pcm_wait().
+ *
+ * Playback starts only once the whole buffer has been filled, so that
+ * the stream opens with as much in hand as it will ever have.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "audio.h"
+
+#ifdef HAS_ALSA
+#include <alsa/asoundlib.h>
+
+
+typedef struct
+{
+    snd_pcm_t* pcm;
+    int mmap;
+    snd_pcm_uframes_t period;
+    long wake;              /* handle->wake as last applied */
+} alsa_sink;
+
+
+
+/* The start threshold snd_pcm_set_params() picks is rounded down to
+ * whole periods; ask for the full buffer instead.  The main loop writes
+ * in blocks that may not divide it, so alsa_poll_fds() still starts the
+ * PCM if the remaining room is too small for another block. */
+static void alsa_set_start(audio_dev_handle* handle, alsa_sink* sink)
+{
+    snd_pcm_uframes_t buffer, period;
+    snd_pcm_sw_params_t* params;
+
+    handle->buffer = 0;
+    if (snd_pcm_get_params(sink->pcm, &buffer, &period) < 0)
+    {
+        return;
+    }
+    handle->buffer = buffer;
+    sink->period   = period;
+
+    if (snd_pcm_sw_params_malloc(&params) < 0)
+    {
+        return;
+    }
+    if (snd_pcm_sw_params_current(sink->pcm, params) < 0 ||
+        snd_pcm_sw_params_set_start_threshold(sink->pcm, params, buffer) < 0 ||
+        snd_pcm_sw_params(sink->pcm, params) < 0)
+    {
+        fprintf(stderr, "Warning: could not set the ALSA start threshold.\n");
+    }
+    snd_pcm_sw_params_free(params);
+}
+
+
+
+static int alsa_open(audio_dev_handle* handle)
+{
+    alsa_sink* sink;
+    const char* device = handle->device != NULL ? handle->device : "default";
+    int err;
+
+    if ((sink = (alsa_sink *) calloc(1, sizeof(alsa_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate ALSA output.\n");
+        return -1;
+    }
+
+    /* Set up the sound card */
+    if ( (err = snd_pcm_open(&sink->pcm, device, SND_PCM_STREAM_PLAYBACK,
+                    SND_PCM_NONBLOCK)) < 0 )
+    {
+        fprintf(stderr, "snd_pcm_open failed: %s\n", snd_strerror(err));
+        free(sink);
+        return -1;
+    }
+
+    sink->mmap = 1;
+    if ( (err = snd_pcm_set_params(sink->pcm,
+                                   SND_PCM_FORMAT_U8,
+                                   SND_PCM_ACCESS_MMAP_INTERLEAVED,
+                                   handle->channels,
+                                   handle->rate,
+                                   1, /* allow resampling */
+                                   handle->latency * 1000)) < 0)
+    {
+        sink->mmap = 0;
+        err = snd_pcm_set_params(sink->pcm,
+                                 SND_PCM_FORMAT_U8,
+                                 SND_PCM_ACCESS_RW_INTERLEAVED,
+                                 handle->channels,
+                                 handle->rate,
+                                 1,
+                                 handle->latency * 1000);
+    }
+    if (err < 0)
+    {
+        fprintf(stderr, "snd_pcm_set_params failed: %s\n", snd_strerror(err));
+        snd_pcm_close(sink->pcm);
+        free(sink);
+        return -1;
+    }
+
+    alsa_set_start(handle, sink);
+
+    handle->priv = sink;
+    return 0;
+}
+
+
+
+static int alsa_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+    snd_pcm_sframes_t n;
+
+    while (size > 0)
+    {
+        n = sink->mmap ? snd_pcm_mmap_writei(sink->pcm, buffer, size) :
+                         snd_pcm_writei(sink->pcm, buffer, size);
+        if (n == -EAGAIN)
+        {
+            snd_pcm_wait(sink->pcm, 1000);
+            continue;
+        }
+        if (n < 0)
+        {
+            /* Underruns and suspends are recovered from; anything else
+             * means the device is gone */
+            if (n == -EPIPE)
+            {
+                handle->xruns++;
+            }
+            if ((n = snd_pcm_recover(sink->pcm, n, 1)) < 0)
+            {
+                fprintf(stderr, "snd_pcm_writei failed: %s\n", snd_strerror(n));
+                return -1;
+            }
+            continue;
+        }
+        buffer += n * handle->channels;
+        size   -= n;
+    }
+
+    /* The write which reaches the start threshold starts the PCM */
+    if (!handle->started && snd_pcm_state(sink->pcm) == SND_PCM_STATE_RUNNING)
+    {
+        audio_started(handle);
+    }
+    return 0;
+}
+
+
+
+static long alsa_delay(audio_dev_handle* handle)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+    snd_pcm_sframes_t delay;
+
+    if (snd_pcm_delay(sink->pcm, &delay) < 0)
+    {
+        return -1;
+    }
+    return delay;
+}
+
+
+
+/* Sleep through periods until there is room for handle->wake frames,
+ * when that is more than a period */
+static void alsa_set_wakeup(audio_dev_handle* handle, alsa_sink* sink)
+{
+    snd_pcm_uframes_t frames = (snd_pcm_uframes_t) handle->wake > sink->period ?
+                               (snd_pcm_uframes_t) handle->wake : sink->period;
+    snd_pcm_sw_params_t* params;
+
+    sink->wake = handle->wake;
+    if (snd_pcm_sw_params_malloc(&params) < 0)
+    {
+        return;
+    }
+    if (snd_pcm_sw_params_current(sink->pcm, params) < 0 ||
+        snd_pcm_sw_params_set_avail_min(sink->pcm, params, frames) < 0 ||
+        snd_pcm_sw_params(sink->pcm, params) < 0)
+    {
+        fprintf(stderr, "Warning: could not set the ALSA wakeup threshold.\n");
+    }
+    snd_pcm_sw_params_free(params);
+}
+
+
+
+/* Start playback if the PCM is still waiting for its buffer to fill */
+static void alsa_start(audio_dev_handle* handle)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+
+    if (snd_pcm_state(sink->pcm) == SND_PCM_STATE_PREPARED)
+    {
+        audio_started(handle);
+        snd_pcm_start(sink->pcm);
+    }
+}
+
+
+
+/* Called just before sleeping on the PCM.  The buffer may hold less
+ * than the start threshold and still have no room for another block;
+ * if so, start playback now, or the buffer would never drain. */
+static int alsa_poll_fds(audio_dev_handle* handle, struct pollfd* fds, int max)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+
+    if (sink->wake != handle->wake)
+    {
+        alsa_set_wakeup(handle, sink);
+    }
+    alsa_start(handle);
+    return snd_pcm_poll_descriptors(sink->pcm, fds, max);
+}
+
+
+
+/* Plugins may use their descriptors in odd ways; ALSA knows which
+ * events really mean the PCM wants attention */
+static unsigned short alsa_revents(audio_dev_handle* handle, struct pollfd* fds, int n)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+    unsigned short revents;
+
+    if (snd_pcm_poll_descriptors_revents(sink->pcm, fds, n, &revents) < 0)
+    {
+        return POLLERR;
+    }
+    return revents;
+}
+
+
+
+static long alsa_avail(audio_dev_handle* handle)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+    snd_pcm_sframes_t n;
+
+    if ((n = snd_pcm_avail_update(sink->pcm)) < 0)
+    {
+        if (n == -EPIPE)
+        {
+            handle->xruns++;
+        }
+        if ((n = snd_pcm_recover(sink->pcm, n, 1)) < 0)
+        {
+            fprintf(stderr, "snd_pcm_avail_update failed: %s\n", snd_strerror(n));
+            return -1;
+        }
+        n = snd_pcm_avail_update(sink->pcm);
+    }
+    return n < 0 ? 0 : n;
+}
+
+
+
+static void alsa_close(audio_dev_handle* handle)
+{
+    alsa_sink* sink = (alsa_sink *) handle->priv;
+
+    if (sink != NULL)
+    {
+        snd_pcm_close(sink->pcm);
+        free(sink);
+        handle->priv = NULL;
+    }
+}
+
+
+
+const audio_backend alsa_backend =
+{
+    "alsa", "alsa[:DEVICE]", "ALSA device (default \"default\")",
+    alsa_open, alsa_write, alsa_delay, NULL, alsa_close,
+    alsa_poll_fds, alsa_revents, alsa_avail, NULL, alsa_start
+};
+
+#endif
+
+
+/* arch-tag: ALSA output */
@@ -0,0 +1,200 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_file.c
+ * Writes the samples to a file, as fast as they are generated.  Files
+ * whose names end in ".wav" get a WAV header; anything else is raw PCM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include "audio.h"
+
+#define FILE_DEFAULT_NAME "whitenoise.raw"
+
+
+typedef struct
+{
+    FILE* f;
+    int wav;
+    int rate;               /* rate recorded in the header */
+    long frames;
+} file_sink;
+
+
+
+static void put16(unsigned char* p, uint16_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = val >> 8;
+}
+
+
+
+static void put32(unsigned char* p, uint32_t val)
+{
+    put16(p, val & 0xffff);
+    put16(p + 2, val >> 16);
+}
+
+
+
+/* Fill in the WAV_HEADER_SIZE bytes of 'h'.  'bytes' is the size of the
+ * data chunk; if it is not yet known, pass WAV_UNKNOWN_SIZE, so that
+ * streaming readers play to the end.  Also used by the stdout output. */
+void audio_wav_header(unsigned char* h, int rate, int channels, uint32_t bytes)
+{
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, bytes + WAV_HEADER_SIZE - 8);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1);                       /* PCM */
+    put16(h + 22, channels);
+    put32(h + 24, rate);
+    put32(h + 28, rate * channels);         /* bytes per second */
+    put16(h + 32, channels);                /* bytes per frame */
+    put16(h + 34, 8);
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, bytes);
+}
+
+
+
+static int wav_header(file_sink* sink, int channels, uint32_t bytes)
+{
+    unsigned char h[WAV_HEADER_SIZE];
+
+    audio_wav_header(h, sink->rate, channels, bytes);
+    return fwrite(h, WAV_HEADER_SIZE, 1, sink->f) == 1 ? 0 : -1;
+}
+
+
+
+static int file_open(audio_dev_handle* handle)
+{
+    file_sink* sink;
+    const char* name = handle->device != NULL ? handle->device : FILE_DEFAULT_NAME;
+    size_t len = strlen(name);
+
+    if ((sink = (file_sink *) calloc(1, sizeof(file_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate file output.\n");
+        return -1;
+    }
+    if ((sink->f = fopen(name, "wb")) == NULL)
+    {
+        fprintf(stderr, "Error: could not open \"%s\" for writing.\n", name);
+        free(sink);
+        return -1;
+    }
+
+    sink->rate = handle->rate;
+    sink->wav  = len >= 4 && strcasecmp(name + len - 4, ".wav") == 0;
+    if (sink->wav && wav_header(sink, handle->channels, WAV_UNKNOWN_SIZE) < 0)
+    {
+        fprintf(stderr, "Error: could not write to \"%s\".\n", name);
+        fclose(sink->f);
+        free(sink);
+        return -1;
+    }
+
+    handle->priv    = sink;
+    handle->unpaced = 1;
+    return 0;
+}
+
+
+
+static int file_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    file_sink* sink = (file_sink *) handle->priv;
+
+    if (fwrite(buffer, handle->channels, size, sink->f) != (size_t) size)
+    {
+        fprintf(stderr, "Error: could not write to the output file.\n");
+        return -1;
+    }
+    sink->frames += size;
+    return 0;
+}
+
+
+
+static long file_delay(audio_dev_handle* handle)
+{
+    return 0;
+}
+
+
+
+/* Keep writing to the same file.  A raw file simply changes rate; a WAV
+ * header can only describe one. */
+static int file_reconfigure(audio_dev_handle* handle)
+{
+    file_sink* sink = (file_sink *) handle->priv;
+
+    if (sink->wav && handle->rate != sink->rate)
+    {
+        fprintf(stderr, "Warning: the WAV file keeps its rate of %d Hz.\n", sink->rate);
+    }
+    return 0;
+}
+
+
+
+static void file_close(audio_dev_handle* handle)
+{
+    file_sink* sink = (file_sink *) handle->priv;
+    long bytes;
+
+    if (sink == NULL)
+    {
+        return;
+    }
+
+    /* Fill in the real size, if the file is seekable */
+    bytes = sink->frames * handle->channels;
+    if (sink->wav && bytes <= (long) WAV_UNKNOWN_SIZE &&
+        fseek(sink->f, 0, SEEK_SET) == 0)
+    {
+        wav_header(sink, handle->channels, bytes);
+    }
+    if (fclose(sink->f) != 0)
+    {
+        fprintf(stderr, "Error: could not write to the output file.\n");
+    }
+    free(sink);
+    handle->priv = NULL;
+}
+
+
+
+const audio_backend file_backend =
+{
+    "file", "file[:NAME]", "raw file, or WAV if 'NAME' ends in\n"
+                           ".wav (default " FILE_DEFAULT_NAME ")",
+    file_open, file_write, file_delay, file_reconfigure, file_close,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+
+/* arch-tag: file output */
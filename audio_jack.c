@@ -0,0 +1,329 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_jack.c
+ * JACK output.  JACK pulls samples from its own realtime thread, so the
+ * audio loop pushes into a lock-free ring which the process callback
+ * drains.  The callback posts a semaphore each period, which is what a
+ * writer waiting for room sleeps on.
+ *
+ * The callback plays silence until the ring has been filled once, so the
+ * stream starts with the whole buffer in hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "audio.h"
+
+#ifdef HAS_JACK
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <jack/jack.h>
+#include "noise.h"
+#include "ring.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+/* Frames converted at a time in the process callback */
+#define JACK_CHUNK 256
+
+
+typedef struct
+{
+    jack_client_t* client;
+    jack_port_t* ports[MAX_CHANNELS];
+    int channels;
+    ring queue;
+    long limit;             /* most frames queued at once */
+    sem_t space;
+    atomic_int failed;
+    atomic_int primed;      /* the ring has been filled; start playing */
+    atomic_long xruns;      /* periods cut short since the last write */
+} jack_sink;
+
+
+
+static int jack_process(jack_nframes_t nframes, void* arg)
+{
+    jack_sink* sink = (jack_sink *) arg;
+    jack_default_audio_sample_t* out[MAX_CHANNELS];
+    unsigned char buf[JACK_CHUNK * MAX_CHANNELS];
+    int C = sink->channels;
+    jack_nframes_t done = 0, i, n;
+    int c;
+
+    for (c=0; c<C; c++)
+    {
+        out[c] = (jack_default_audio_sample_t *)
+            jack_port_get_buffer(sink->ports[c], nframes);
+    }
+
+    while (atomic_load(&sink->primed) && done < nframes)
+    {
+        n = MIN(nframes - done, JACK_CHUNK);
+        n = ring_read(&sink->queue, buf, n * C) / C;
+        if (n == 0)
+        {
+            break;
+        }
+        for (i=0; i<n; i++)
+        {
+            for (c=0; c<C; c++)
+            {
+                out[c][done+i] = ((float) buf[i*C + c] - 128.0f) / 128.0f;
+            }
+        }
+        done += n;
+    }
+
+    /* Underrun: play silence rather than stale samples */
+    if (done < nframes && atomic_load(&sink->primed))
+    {
+        atomic_fetch_add(&sink->xruns, 1);
+    }
+    for (c=0; c<C; c++)
+    {
+        memset(out[c] + done, 0, (nframes - done) * sizeof(jack_default_audio_sample_t));
+    }
+
+    sem_post(&sink->space);
+    return 0;
+}
+
+
+
+static void jack_shutdown(void* arg)
+{
+    jack_sink* sink = (jack_sink *) arg;
+
+    atomic_store(&sink->failed, 1);
+    sem_post(&sink->space);
+}
+
+
+
+/* Connect our ports, in order, to the ports matching 'pattern', or to
+ * the physical outputs */
+static void jack_connect_ports(jack_sink* sink, const char* pattern)
+{
+    const char** targets;
+    int c, n;
+
+    targets = jack_get_ports(sink->client, pattern, JACK_DEFAULT_AUDIO_TYPE,
+            JackPortIsInput | (pattern == NULL ? JackPortIsPhysical : 0));
+    if (targets == NULL || targets[0] == NULL)
+    {
+        fprintf(stderr, "Warning: no JACK ports to connect to.\n");
+        jack_free(targets);
+        return;
+    }
+
+    for (n=0; targets[n] != NULL; n++);
+    for (c=0; c<sink->channels; c++)
+    {
+        jack_connect(sink->client, jack_port_name(sink->ports[c]), targets[c % n]);
+    }
+    jack_free(targets);
+}
+
+
+
+static void jack_free_sink(jack_sink* sink)
+{
+    if (sink->client != NULL)
+    {
+        jack_client_close(sink->client);
+    }
+    if (sink->queue.buf != NULL)
+    {
+        ring_exit(&sink->queue);
+    }
+    sem_destroy(&sink->space);
+    free(sink);
+}
+
+
+
+static int jack_open(audio_dev_handle* handle)
+{
+    jack_sink* sink;
+    jack_status_t status;
+    char name[16];
+    size_t size;
+    int c, serverRate;
+
+    if ((sink = (jack_sink *) calloc(1, sizeof(jack_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate JACK output.\n");
+        return -1;
+    }
+    sink->channels = handle->channels;
+    sem_init(&sink->space, 0, 0);
+
+    if ((sink->client = jack_client_open("whitenoise", JackNoStartServer, &status)) == NULL)
+    {
+        fprintf(stderr, "Could not connect to the JACK server.\n");
+        jack_free_sink(sink);
+        return -1;
+    }
+
+    /* JACK runs every client at the server's rate.  The filter cutoff is
+     * relative to the rate, so the noise simply plays at that rate. */
+    serverRate = jack_get_sample_rate(sink->client);
+    if (serverRate != handle->rate)
+    {
+        fprintf(stderr, "Warning: the JACK server runs at %d Hz; using that rate.\n",
+                serverRate);
+        handle->rate = serverRate;
+    }
+
+    sink->limit = MAX((long) handle->latency * handle->rate / 1000,
+                      (long) jack_get_buffer_size(sink->client));
+    handle->buffer = sink->limit;
+    for (size = 1; size < (size_t) sink->limit * sink->channels; size <<= 1);
+    if (ring_init(&sink->queue, size) < 0)
+    {
+        fprintf(stderr, "Error: could not allocate JACK output.\n");
+        jack_free_sink(sink);
+        return -1;
+    }
+
+    for (c=0; c<sink->channels; c++)
+    {
+        snprintf(name, sizeof(name), "out_%d", c + 1);
+        sink->ports[c] = jack_port_register(sink->client, name,
+                JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (sink->ports[c] == NULL)
+        {
+            fprintf(stderr, "Could not register JACK port %s.\n", name);
+            jack_free_sink(sink);
+            return -1;
+        }
+    }
+
+    jack_set_process_callback(sink->client, jack_process, sink);
+    jack_on_shutdown(sink->client, jack_shutdown, sink);
+    if (jack_activate(sink->client) != 0)
+    {
+        fprintf(stderr, "Could not activate JACK client.\n");
+        jack_free_sink(sink);
+        return -1;
+    }
+    jack_connect_ports(sink, handle->device);
+
+    handle->priv = sink;
+    return 0;
+}
+
+
+
+static int jack_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    jack_sink* sink = (jack_sink *) handle->priv;
+    int C = sink->channels;
+    struct timespec timeout;
+    long n;
+
+    while (size > 0)
+    {
+        if (atomic_load(&sink->failed))
+        {
+            fprintf(stderr, "The JACK server has shut down.\n");
+            return -1;
+        }
+
+        n = MIN((long) (ring_space(&sink->queue) / C),
+                sink->limit - (long) (ring_fill(&sink->queue) / C));
+        if (n <= 0)
+        {
+            /* Wait for the next period, but not forever if JACK has
+             * stopped calling us */
+            clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_sec += 1;
+            if (sem_timedwait(&sink->space, &timeout) < 0 && errno == ETIMEDOUT)
+            {
+                fprintf(stderr, "The JACK server stopped processing.\n");
+                return -1;
+            }
+            continue;
+        }
+
+        n = MIN(n, size);
+        ring_write(&sink->queue, buffer, n * C);
+        buffer += n * C;
+        size   -= n;
+
+        if (!atomic_load(&sink->primed) && (long) (ring_fill(&sink->queue) / C) >= sink->limit)
+        {
+            audio_started(handle);
+            atomic_store(&sink->primed, 1);
+        }
+    }
+
+    handle->xruns += atomic_exchange(&sink->xruns, 0);
+    return 0;
+}
+
+
+
+static long jack_delay(audio_dev_handle* handle)
+{
+    jack_sink* sink = (jack_sink *) handle->priv;
+    jack_latency_range_t range;
+
+    jack_port_get_latency_range(sink->ports[0], JackPlaybackLatency, &range);
+    return (long) (ring_fill(&sink->queue) / sink->channels) + range.max;
+}
+
+
+
+static void jack_close(audio_dev_handle* handle)
+{
+    jack_sink* sink = (jack_sink *) handle->priv;
+
+    if (sink != NULL)
+    {
+        jack_free_sink(sink);
+        handle->priv = NULL;
+    }
+}
+
+
+
+const audio_backend jack_backend =
+{
+    "jack", "jack[:PORTS]", "JACK, connected to the ports\n"
+                            "matching regex 'PORTS' (default:\n"
+                            "the physical outputs)",
+    jack_open, jack_write, jack_delay, NULL, jack_close,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+#endif
+
+
+/* arch-tag: JACK output */
@@ -0,0 +1,162 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_null.c
+ * Discards the samples.  By default it behaves like a sound card with a
+ * buffer of 'latency' milliseconds, which starts draining at the sample
+ * rate once it is full and underruns if it runs dry, so the program runs
+ * exactly as it would with real output.  Unclocked, it
+ * accepts everything at once, which measures raw render throughput.
+ * Either way the totals are reported when it is closed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio.h"
+
+
+typedef struct
+{
+    int clocked;
+    audio_clock clock;
+    struct timespec opened;
+    long long frames;
+} null_sink;
+
+
+
+static int null_open(audio_dev_handle* handle)
+{
+    null_sink* sink;
+
+    if ((sink = (null_sink *) calloc(1, sizeof(null_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate null output.\n");
+        return -1;
+    }
+
+    if (handle->device == NULL || strcmp(handle->device, "clocked") == 0)
+    {
+        sink->clocked = 1;
+    }
+    else if (strcmp(handle->device, "unclocked") != 0)
+    {
+        fprintf(stderr, "Error: null output must be \"clocked\" or \"unclocked\".\n");
+        free(sink);
+        return -1;
+    }
+
+    if (sink->clocked)
+    {
+        audio_clock_init(handle, &sink->clock);
+    }
+    else
+    {
+        handle->unpaced = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &sink->opened);
+    handle->priv = sink;
+    return 0;
+}
+
+
+
+static int null_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    null_sink* sink = (null_sink *) handle->priv;
+
+    if (sink->clocked)
+    {
+        audio_clock_write(handle, &sink->clock, size);
+    }
+    sink->frames += size;
+    return 0;
+}
+
+
+
+static long null_delay(audio_dev_handle* handle)
+{
+    null_sink* sink = (null_sink *) handle->priv;
+
+    if (sink->clocked)
+    {
+        return audio_clock_delay(handle, &sink->clock);
+    }
+    return 0;
+}
+
+
+
+/* The virtual buffer picks up the new rate and latency by itself, and
+ * the totals carry on */
+static int null_reconfigure(audio_dev_handle* handle)
+{
+    null_sink* sink = (null_sink *) handle->priv;
+
+    if (sink->clocked)
+    {
+        handle->buffer = (long) handle->latency * handle->rate / 1000;
+    }
+    return 0;
+}
+
+
+
+static void null_close(audio_dev_handle* handle)
+{
+    null_sink* sink = (null_sink *) handle->priv;
+    struct timespec now;
+    double seconds;
+
+    if (sink == NULL)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (double) (now.tv_sec - sink->opened.tv_sec) +
+              (double) (now.tv_nsec - sink->opened.tv_nsec) * 1e-9;
+    fprintf(stderr, "null output: %lld frames in %.2f s", sink->frames, seconds);
+    if (seconds > 0.0)
+    {
+        fprintf(stderr, " (%.1f times realtime)",
+                (double) sink->frames / handle->rate / seconds);
+    }
+    fprintf(stderr, "\n");
+
+    free(sink);
+    handle->priv = NULL;
+}
+
+
+
+const audio_backend null_backend =
+{
+    "null", "null[:unclocked]", "discard at the playback rate, or\n"
+                                "as fast as possible if unclocked",
+    null_open, null_write, null_delay, null_reconfigure, null_close,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+
+/* arch-tag: null output */
@@ -0,0 +1,119 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_pulse.c
+ * PulseAudio output, through the simple API.  PipeWire serves the same
+ * protocol, so this covers both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "audio.h"
+
+#ifdef HAS_PULSE
+#include <pulse/simple.h>
+#include <pulse/error.h>
+
+
+static int pulse_open(audio_dev_handle* handle)
+{
+    pa_simple* stream;
+    pa_sample_spec spec;
+    pa_buffer_attr attr;
+    int err;
+
+    spec.format   = PA_SAMPLE_U8;
+    spec.rate     = handle->rate;
+    spec.channels = handle->channels;
+
+    /* Only the target fill level matters; let the server pick the rest */
+    attr.maxlength = (uint32_t) -1;
+    attr.tlength   = pa_usec_to_bytes((pa_usec_t) handle->latency * 1000, &spec);
+    attr.prebuf    = (uint32_t) -1;
+    attr.minreq    = (uint32_t) -1;
+    attr.fragsize  = (uint32_t) -1;
+
+    stream = pa_simple_new(NULL, "whitenoise", PA_STREAM_PLAYBACK, handle->device,
+            "noise", &spec, NULL, &attr, &err);
+    if (stream == NULL)
+    {
+        fprintf(stderr, "Could not connect to PulseAudio: %s\n", pa_strerror(err));
+        return -1;
+    }
+
+    handle->priv = stream;
+    return 0;
+}
+
+
+
+static int pulse_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    int err;
+
+    if (pa_simple_write((pa_simple *) handle->priv, buffer,
+                (size_t) size * handle->channels, &err) < 0)
+    {
+        fprintf(stderr, "pa_simple_write failed: %s\n", pa_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+
+
+static long pulse_delay(audio_dev_handle* handle)
+{
+    pa_usec_t usec;
+    int err;
+
+    usec = pa_simple_get_latency((pa_simple *) handle->priv, &err);
+    if (usec == (pa_usec_t) -1)
+    {
+        return -1;
+    }
+    return (long) (usec * handle->rate / 1000000);
+}
+
+
+
+static void pulse_close(audio_dev_handle* handle)
+{
+    if (handle->priv != NULL)
+    {
+        pa_simple_free((pa_simple *) handle->priv);
+        handle->priv = NULL;
+    }
+}
+
+
+
+const audio_backend pulse_backend =
+{
+    "pulse", "pulse[:SINK]", "PulseAudio or PipeWire sink\n"
+                             "(default: the server's default)",
+    pulse_open, pulse_write, pulse_delay, NULL, pulse_close,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+#endif
+
+
+/* arch-tag: PulseAudio output */
@@ -0,0 +1,283 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_shm.c
+ * Publishes the noise in a POSIX shared-memory ring, for any number of
+ * local processes to read through shmclient.h.  It is paced like a sound
+ * card with a buffer of 'latency' milliseconds, so whitenoise runs as a
+ * daemon producing one live stream.  The noise is rendered once however
+ * many readers there are: each keeps its own cursor, and the writer never
+ * looks at them.
+ *
+ * Frames are copied into the ring and then published by advancing
+ * 'written'.  Readers waiting for data sleep on a futex, which costs the
+ * writer one system call per publish however many are asleep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "audio.h"
+#include "shmring.h"
+
+/* Seconds of noise the ring holds, at least */
+#define SHM_SECONDS 2
+
+/* The ring starts on its own page */
+#define SHM_OFFSET 4096
+
+
+typedef struct
+{
+    char name[NAME_MAX];
+    void* map;
+    size_t length;
+    shmring_header* header;
+    unsigned char* ring;
+    audio_clock clock;
+} shm_sink;
+
+
+
+/* A writer left behind by a crash can be replaced; a live one cannot */
+static int shm_stale(const char* name)
+{
+    shmring_header header;
+    int fd, stale = 1;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+    {
+        return 1;
+    }
+    if (read(fd, &header, sizeof(header)) == (ssize_t) sizeof(header) &&
+        atomic_load(&header.magic) == SHMRING_MAGIC &&
+        !atomic_load(&header.closed) &&
+        (kill(header.pid, 0) == 0 || errno == EPERM))
+    {
+        stale = 0;
+    }
+    close(fd);
+    return stale;
+}
+
+
+
+static int shm_open_ring(audio_dev_handle* handle, shm_sink* sink)
+{
+    uint64_t frames;
+    int fd;
+
+    fd = shm_open(sink->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && shm_stale(sink->name))
+    {
+        shm_unlink(sink->name);
+        fd = shm_open(sink->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0)
+    {
+        if (errno == EEXIST)
+        {
+            fprintf(stderr, "Error: another whitenoise is already publishing \"%s\".\n",
+                    sink->name);
+        }
+        else
+        {
+            fprintf(stderr, "Error: could not create shared memory \"%s\": %s\n",
+                    sink->name, strerror(errno));
+        }
+        return -1;
+    }
+
+    /* Room for SHM_SECONDS at the highest rate, and several times the
+     * latency, so that a reader can sleep through a whole buffer */
+    for (frames = 1; frames < (uint64_t) SHM_SECONDS * 22050 ||
+                     frames < 4 * (uint64_t) handle->buffer; frames <<= 1);
+
+    sink->length = SHM_OFFSET + frames * handle->channels;
+    if (ftruncate(fd, sink->length) < 0 ||
+        (sink->map = mmap(NULL, sink->length, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: could not map shared memory \"%s\": %s\n",
+                sink->name, strerror(errno));
+        sink->map = NULL;
+        close(fd);
+        shm_unlink(sink->name);
+        return -1;
+    }
+    close(fd);
+
+    sink->header = (shmring_header *) sink->map;
+    sink->ring   = (unsigned char *) sink->map + SHM_OFFSET;
+
+    sink->header->version  = SHMRING_VERSION;
+    sink->header->channels = handle->channels;
+    sink->header->frames   = frames;
+    sink->header->slack    = frames / 8;
+    sink->header->offset   = SHM_OFFSET;
+    sink->header->pid      = getpid();
+    atomic_store(&sink->header->rate, handle->rate);
+    atomic_store(&sink->header->closed, 0);
+    atomic_store(&sink->header->written, 0);
+    atomic_store(&sink->header->wake, 0);
+    atomic_store(&sink->header->magic, SHMRING_MAGIC);
+    return 0;
+}
+
+
+
+static int shm_sink_open(audio_dev_handle* handle)
+{
+    shm_sink* sink;
+    const char* name = handle->device != NULL ? handle->device : SHMRING_DEFAULT_NAME;
+
+    if ((sink = (shm_sink *) calloc(1, sizeof(shm_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate shared memory output.\n");
+        return -1;
+    }
+
+    /* POSIX names start with a slash */
+    if (snprintf(sink->name, sizeof(sink->name), "%s%s",
+                 name[0] == '/' ? "" : "/", name) >= (int) sizeof(sink->name) ||
+        strchr(sink->name + 1, '/') != NULL)
+    {
+        fprintf(stderr, "Error: invalid shared memory name \"%s\".\n", name);
+        free(sink);
+        return -1;
+    }
+
+    audio_clock_init(handle, &sink->clock);
+    if (shm_open_ring(handle, sink) < 0)
+    {
+        free(sink);
+        return -1;
+    }
+
+    printf("Publishing noise in shared memory \"%s\".\n", sink->name);
+    handle->priv = sink;
+    return 0;
+}
+
+
+
+static void shm_wake(shmring_header* header)
+{
+    atomic_fetch_add(&header->wake, 1);
+    syscall(SYS_futex, &header->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+
+static int shm_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    shm_sink* sink = (shm_sink *) handle->priv;
+    shmring_header* header = sink->header;
+    int C = handle->channels;
+    uint64_t w, pos, first;
+    long n;
+
+    while (size > 0)
+    {
+        n = (uint64_t) size < header->slack ? size : (long) header->slack;
+        audio_clock_write(handle, &sink->clock, n);
+
+        /* Only this process writes 'written' */
+        w     = atomic_load_explicit(&header->written, memory_order_relaxed);
+        pos   = w & (header->frames - 1);
+        first = header->frames - pos < (uint64_t) n ? header->frames - pos : (uint64_t) n;
+        memcpy(sink->ring + pos*C, buffer, first*C);
+        memcpy(sink->ring, buffer + first*C, (n - first)*C);
+
+        atomic_store(&header->written, w + n);
+        /* The count must be visible before any of the next chunk; see
+         * shmring.h */
+        atomic_thread_fence(memory_order_release);
+        shm_wake(header);
+
+        buffer += n * C;
+        size   -= n;
+    }
+    return 0;
+}
+
+
+
+static long shm_delay(audio_dev_handle* handle)
+{
+    shm_sink* sink = (shm_sink *) handle->priv;
+
+    return audio_clock_delay(handle, &sink->clock);
+}
+
+
+
+/* Readers see the new rate in the header; the stream carries on */
+static int shm_reconfigure(audio_dev_handle* handle)
+{
+    shm_sink* sink = (shm_sink *) handle->priv;
+
+    handle->buffer = (long) handle->latency * handle->rate / 1000;
+    atomic_store(&sink->header->rate, handle->rate);
+    return 0;
+}
+
+
+
+static void shm_close(audio_dev_handle* handle)
+{
+    shm_sink* sink = (shm_sink *) handle->priv;
+
+    if (sink == NULL)
+    {
+        return;
+    }
+
+    /* Attached readers keep their mapping, and find out from 'closed' */
+    atomic_store(&sink->header->closed, 1);
+    shm_wake(sink->header);
+    munmap(sink->map, sink->length);
+    shm_unlink(sink->name);
+
+    free(sink);
+    handle->priv = NULL;
+}
+
+
+
+const audio_backend shm_backend =
+{
+    "shm", "shm[:NAME]", "shared memory for local readers,\n"
+                         "paced like a sound card (default\n"
+                         "\"" SHMRING_DEFAULT_NAME "\")",
+    shm_sink_open, shm_write, shm_delay, shm_reconfigure, shm_close,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+
+/* arch-tag: shared-memory output */
@@ -0,0 +1,351 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* audio_stdout.c
+ * Streams raw samples to standard output, for piping into other programs.
+ * Standard output then carries nothing but the samples: the descriptor is
+ * taken over, and descriptor 1 is pointed at stderr, where the status
+ * messages go instead.
+ *
+ * Into a pipe, blocks are handed over with vmsplice(), which passes the
+ * pages themselves rather than copying them.  The pipe then refers to our
+ * memory until it is read, so blocks are rendered into a ring of
+ * page-aligned slots, one more than the pipe can hold, and a slot is only
+ * reused once the pipe must have been emptied of it.  Anything else (a
+ * file, or a block which does not fit a slot) is written as usual.  The
+ * pipe filling up is what paces the rendering.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "audio.h"
+
+
+typedef struct
+{
+    int fd;
+    int splice;             /* vmsplice() still worth trying */
+    int wav;
+    int rate;               /* rate given in the header */
+    long pipeSize;          /* bytes the pipe holds, or 0 if not a pipe */
+
+    unsigned char* ring;    /* page-aligned slots, or NULL until needed */
+    size_t ringSize;
+    size_t slot;            /* bytes per slot, whole pages */
+    int slots;
+    int next;               /* slot to render into next */
+} stdout_sink;
+
+
+
+static int stdout_open(audio_dev_handle* handle)
+{
+    stdout_sink* sink;
+    unsigned char h[WAV_HEADER_SIZE];
+    struct stat st;
+
+    if (handle->device != NULL && strcmp(handle->device, "wav") != 0 &&
+        strcmp(handle->device, "raw") != 0)
+    {
+        fprintf(stderr, "Error: stdout output must be \"raw\" or \"wav\".\n");
+        return -1;
+    }
+    if (isatty(1))
+    {
+        fprintf(stderr, "Error: not writing noise to a terminal; redirect stdout.\n");
+        return -1;
+    }
+    if ((sink = (stdout_sink *) calloc(1, sizeof(stdout_sink))) == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate stdout output.\n");
+        return -1;
+    }
+
+    /* Anything printed from now on, or still buffered, goes to stderr */
+    if ((sink->fd = dup(1)) < 0 || dup2(2, 1) < 0)
+    {
+        fprintf(stderr, "Error: could not take over stdout.\n");
+        free(sink);
+        return -1;
+    }
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    /* A reader going away should end the run, not kill it */
+    signal(SIGPIPE, SIG_IGN);
+
+    sink->pipeSize = fcntl(sink->fd, F_GETPIPE_SZ);
+    sink->splice   = sink->pipeSize > 0;
+    /* A reader sets the pace; a file redirected to does not */
+    handle->unpaced = fstat(sink->fd, &st) == 0 && S_ISREG(st.st_mode);
+    sink->rate     = handle->rate;
+    sink->wav      = handle->device != NULL && strcmp(handle->device, "wav") == 0;
+    handle->priv   = sink;
+
+    if (sink->wav)
+    {
+        audio_wav_header(h, handle->rate, handle->channels, WAV_UNKNOWN_SIZE);
+        if (write(sink->fd, h, WAV_HEADER_SIZE) != WAV_HEADER_SIZE)
+        {
+            fprintf(stderr, "Error: could not write to stdout.\n");
+            close(sink->fd);
+            free(sink);
+            handle->priv = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+/* Set up slots for blocks of 'bytes' bytes, the first time they are
+ * needed.  Returns -1 if vmsplice() is not to be used. */
+static int stdout_ring(stdout_sink* sink, size_t bytes)
+{
+    long page = sysconf(_SC_PAGESIZE);
+
+    if (sink->ring != NULL)
+    {
+        return bytes <= sink->slot ? 0 : -1;
+    }
+
+    /* Every block takes at least one of the pipe's page-sized buffers */
+    sink->slot  = (bytes + page - 1) / page * page;
+    sink->slots = sink->pipeSize / page + 2;
+    sink->ringSize = sink->slot * sink->slots;
+    sink->ring  = (unsigned char *) mmap(NULL, sink->ringSize, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (sink->ring == MAP_FAILED)
+    {
+        sink->ring   = NULL;
+        sink->splice = 0;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+static unsigned char* stdout_buffer(audio_dev_handle* handle, int size)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+
+    if (!sink->splice || stdout_ring(sink, (size_t) size * handle->channels) < 0)
+    {
+        return NULL;
+    }
+    return sink->ring + sink->next * sink->slot;
+}
+
+
+
+static int stdout_write_all(stdout_sink* sink, unsigned char* buffer, size_t bytes)
+{
+    ssize_t n;
+
+    while (bytes > 0)
+    {
+        if ((n = write(sink->fd, buffer, bytes)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, errno == EPIPE ? "The reader of stdout has gone away.\n" :
+                                             "Error: could not write to stdout.\n");
+            return -1;
+        }
+        buffer += n;
+        bytes  -= n;
+    }
+    return 0;
+}
+
+
+
+static int stdout_write(audio_dev_handle* handle, unsigned char* buffer, int size)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+    size_t bytes = (size_t) size * handle->channels;
+    unsigned char* slot;
+    struct iovec iov;
+    ssize_t n;
+
+    if (!sink->splice || stdout_ring(sink, bytes) < 0)
+    {
+        return stdout_write_all(sink, buffer, bytes);
+    }
+
+    /* Blocks rendered elsewhere are copied into the slot first */
+    slot = sink->ring + sink->next * sink->slot;
+    if (buffer != slot)
+    {
+        memcpy(slot, buffer, bytes);
+    }
+    sink->next = (sink->next + 1) % sink->slots;
+
+    iov.iov_base = slot;
+    iov.iov_len  = bytes;
+    while (iov.iov_len > 0)
+    {
+        if ((n = vmsplice(sink->fd, &iov, 1, 0)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EPIPE)
+            {
+                fprintf(stderr, "The reader of stdout has gone away.\n");
+                return -1;
+            }
+            /* Not supported here after all */
+            sink->splice = 0;
+            return stdout_write_all(sink, iov.iov_base, iov.iov_len);
+        }
+        iov.iov_base = (unsigned char *) iov.iov_base + n;
+        iov.iov_len -= n;
+    }
+    return 0;
+}
+
+
+
+/* Frames sitting in the pipe */
+static long stdout_delay(audio_dev_handle* handle)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+    int queued;
+
+    if (sink->pipeSize <= 0 || ioctl(sink->fd, FIONREAD, &queued) < 0)
+    {
+        return 0;
+    }
+    return queued / handle->channels;
+}
+
+
+
+static int stdout_poll_fds(audio_dev_handle* handle, struct pollfd* fds, int max)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+
+    fds[0].fd     = sink->fd;
+    fds[0].events = POLLOUT;
+    return 1;
+}
+
+
+
+static unsigned short stdout_revents(audio_dev_handle* handle, struct pollfd* fds, int n)
+{
+    return fds[0].revents;
+}
+
+
+
+/* A pipe with a free buffer takes at least a page without blocking.  The
+ * room in bytes is only a guide, since each spliced block takes a whole
+ * buffer of the pipe however small it is; the write blocks if need be.
+ * Files and other descriptors always count as writable. */
+static long stdout_avail(audio_dev_handle* handle)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+    struct pollfd fd;
+    int queued;
+
+    if (sink->pipeSize <= 0)
+    {
+        return 1L << 30;
+    }
+    fd.fd     = sink->fd;
+    fd.events = POLLOUT;
+    if (poll(&fd, 1, 0) < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (fd.revents & POLLERR)
+    {
+        fprintf(stderr, "The reader of stdout has gone away.\n");
+        return -1;
+    }
+    if (!(fd.revents & POLLOUT) || ioctl(sink->fd, FIONREAD, &queued) < 0)
+    {
+        return 0;
+    }
+    return (sink->pipeSize - queued) / handle->channels;
+}
+
+
+
+/* The stream simply changes rate; a WAV header can only describe one */
+static int stdout_reconfigure(audio_dev_handle* handle)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+
+    if (sink->wav && handle->rate != sink->rate)
+    {
+        fprintf(stderr, "Warning: the WAV stream keeps its rate of %d Hz.\n", sink->rate);
+    }
+    return 0;
+}
+
+
+
+/* Pages still in the pipe stay valid after the ring is unmapped */
+static void stdout_close(audio_dev_handle* handle)
+{
+    stdout_sink* sink = (stdout_sink *) handle->priv;
+
+    if (sink == NULL)
+    {
+        return;
+    }
+    close(sink->fd);
+    if (sink->ring != NULL)
+    {
+        munmap(sink->ring, sink->ringSize);
+    }
+    free(sink);
+    handle->priv = NULL;
+}
+
+
+
+const audio_backend stdout_backend =
+{
+    "stdout", "stdout[:wav]", "raw samples on stdout, or WAV;\n"
+                              "messages go to stderr",
+    stdout_open, stdout_write, stdout_delay, stdout_reconfigure, stdout_close,
+    stdout_poll_fds, stdout_revents, stdout_avail, stdout_buffer, NULL
+};
+
+
+/* arch-tag: stdout output */
@@ -0,0 +1,213 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* cache.c
+ * Keeps rendered noise in ~/.whitenoise/cache, one file per set of
+ * parameters, so that a restart with the same settings can map the
+ * samples straight into memory instead of rendering them again.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "userdir.h"
+
+
+#define CACHE_MAGIC   "WNCACHE1"
+#define FNV_OFFSET    14695981039346656037ULL
+#define FNV_PRIME     1099511628211ULL
+
+
+typedef struct
+{
+    char magic[8];
+    uint64_t key;
+    int64_t length;
+    int64_t reserved;
+} cache_header;
+
+
+static uint64_t fnv1a(uint64_t hash, const void* buf, size_t size)
+{
+    const unsigned char* p = (const unsigned char *) buf;
+    size_t i;
+
+    for (i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/* The filter coefficients stand in for the cutoff, filter type and
+ * filter length, since they are derived from exactly those. */
+uint64_t cache_key(double* coeff, int M, int rate, int channels, long length)
+{
+    uint64_t hash = FNV_OFFSET;
+    int64_t  val;
+
+    hash = fnv1a(hash, CACHE_MAGIC, 8);
+    hash = fnv1a(hash, coeff, M * sizeof(double));
+    val = M;
+    hash = fnv1a(hash, &val, sizeof(val));
+    val = rate;
+    hash = fnv1a(hash, &val, sizeof(val));
+    val = channels;
+    hash = fnv1a(hash, &val, sizeof(val));
+    val = length;
+    hash = fnv1a(hash, &val, sizeof(val));
+
+    return hash;
+}
+
+
+static char * cache_path(uint64_t key, const char* suffix)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s/%016llx.pcm%s", CACHE_RELPATH,
+            (unsigned long long) key, suffix);
+    return userdir_path(name);
+}
+
+
+
+/* Map the cached samples for 'key' into memory.  Returns a pointer to
+ * 'length' bytes of samples, or NULL if nothing usable is cached.  The
+ * mapping is returned in 'map' and 'map_size', for cache_unmap(). */
+unsigned char * cache_map(uint64_t key, long length, void** map, size_t* map_size)
+{
+    char* path;
+    int fd;
+    struct stat st;
+    void* addr;
+    cache_header* header;
+
+    if ((path = cache_path(key, "")) == NULL)
+    {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 ||
+        st.st_size != (off_t) (sizeof(cache_header) + length))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    header = (cache_header *) addr;
+    if (memcmp(header->magic, CACHE_MAGIC, 8) != 0 ||
+        header->key != key || header->length != length)
+    {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+
+    /* Playback is sequential; let the kernel read ahead */
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    *map      = addr;
+    *map_size = st.st_size;
+    return (unsigned char *) addr + sizeof(cache_header);
+}
+
+
+
+void cache_unmap(void* map, size_t map_size)
+{
+    munmap(map, map_size);
+}
+
+
+
+/* Save 'length' bytes of samples under 'key'.  The file is written
+ * under a temporary name of its own and renamed into place, so a reader
+ * never maps a partial file, even when several processes save the same
+ * loop at once. */
+int cache_store(uint64_t key, unsigned char* samples, long length)
+{
+    char* path = NULL;
+    char* tmp_path = NULL;
+    FILE* f;
+    cache_header header;
+    int fd, ok;
+
+    if ((path = cache_path(key, "")) == NULL ||
+        (tmp_path = cache_path(key, ".XXXXXX")) == NULL)
+    {
+        free(path);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.key    = key;
+    header.length = length;
+
+    if ((fd = mkstemp(tmp_path)) < 0)
+    {
+        free(path);
+        free(tmp_path);
+        return -1;
+    }
+    if ((f = fdopen(fd, "wb")) == NULL)
+    {
+        close(fd);
+        unlink(tmp_path);
+        free(path);
+        free(tmp_path);
+        return -1;
+    }
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(samples, 1, length, f) == (size_t) length;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp_path, path) < 0)
+    {
+        unlink(tmp_path);
+        ok = 0;
+    }
+
+    free(path);
+    free(tmp_path);
+    return ok ? 0 : -1;
+}
+
+
+/* arch-tag: rendered noise cache */
@@ -0,0 +1,37 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CACHE_RELPATH "cache"
+
+
+uint64_t cache_key( double*, int, int, int, long );
+unsigned char * cache_map( uint64_t, long, void**, size_t* );
+void cache_unmap( void*, size_t );
+int cache_store( uint64_t, unsigned char*, long );
+
+
+#endif
+
+
+/* arch-tag: rendered noise cache (header) */
@@ -0,0 +1,150 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* fft.c
+ * All FFTW plans are made here.  Nothing is set up until the first plan is
+ * requested; at that point any wisdom saved by a previous run is loaded
+ * from ~/.whitenoise, and any new wisdom is saved again at exit.  The FFTW
+ * planner is not thread-safe, so it is serialized with a lock.
+ */
+
+#include "fft.h"
+
+#ifdef HAS_FFTW3
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "userdir.h"
+
+
+static pthread_mutex_t planner_lock = PTHREAD_MUTEX_INITIALIZER;
+static int wisdom_loaded = 0;
+static int wisdom_changed = 0;
+
+
+static void fft_load_wisdom(void)
+{
+    char* path;
+
+    wisdom_loaded = 1;
+    if ((path = userdir_path(WISDOM_NAME)) != NULL)
+    {
+        fftw_import_wisdom_from_filename(path);
+        free(path);
+    }
+}
+
+
+/* Plans found in the wisdom file are used as they are; wisdom from a more
+ * patient search satisfies a measured lookup too.  Otherwise a measured
+ * plan is made, which costs some time once and is then remembered.  Only
+ * a miss adds to the wisdom, so the file is rewritten only when needed. */
+static fftw_plan fft_plan(int n, double* real, fftw_complex* cplx, int forward)
+{
+    fftw_plan p;
+
+    pthread_mutex_lock(&planner_lock);
+    if (!wisdom_loaded)
+    {
+        fft_load_wisdom();
+    }
+
+    if (forward)
+    {
+        p = fftw_plan_dft_r2c_1d(n, real, cplx, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    }
+    else
+    {
+        p = fftw_plan_dft_c2r_1d(n, cplx, real, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    }
+
+    if (p == NULL)
+    {
+        if (forward)
+        {
+            p = fftw_plan_dft_r2c_1d(n, real, cplx, FFTW_MEASURE);
+        }
+        else
+        {
+            p = fftw_plan_dft_c2r_1d(n, cplx, real, FFTW_MEASURE);
+        }
+        wisdom_changed |= (p != NULL);
+    }
+    pthread_mutex_unlock(&planner_lock);
+
+    return p;
+}
+
+
+
+/* Plan a real-to-complex transform of length 'n'.  Planning overwrites
+ * both arrays. */
+fftw_plan fft_plan_r2c(int n, double* in, fftw_complex* out)
+{
+    return fft_plan(n, in, out, 1);
+}
+
+
+
+/* Plan a complex-to-real transform of length 'n'.  Planning overwrites
+ * both arrays. */
+fftw_plan fft_plan_c2r(int n, fftw_complex* in, double* out)
+{
+    return fft_plan(n, out, in, 0);
+}
+
+
+
+void fft_destroy_plan(fftw_plan p)
+{
+    pthread_mutex_lock(&planner_lock);
+    fftw_destroy_plan(p);
+    pthread_mutex_unlock(&planner_lock);
+}
+
+
+
+/* Save new wisdom and release FFTW's internal state.  All plans must have
+ * been destroyed first. */
+void fft_exit(void)
+{
+    char* path;
+
+    pthread_mutex_lock(&planner_lock);
+    if (wisdom_changed && (path = userdir_path(WISDOM_NAME)) != NULL)
+    {
+        if (!fftw_export_wisdom_to_filename(path))
+        {
+            fprintf(stderr, "Warning: could not save FFTW wisdom.\n");
+        }
+        free(path);
+    }
+    wisdom_changed = 0;
+    if (wisdom_loaded)
+    {
+        fftw_cleanup();
+        wisdom_loaded = 0;
+    }
+    pthread_mutex_unlock(&planner_lock);
+}
+
+#endif /* HAS_FFTW3 */
+
+
+/* arch-tag: FFTW planning and wisdom */
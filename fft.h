@@ -0,0 +1,41 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef FFT_H
+#define FFT_H 1
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAS_FFTW3
+#include <fftw3.h>
+
+#define WISDOM_NAME "fftw-wisdom"
+
+fftw_plan fft_plan_r2c( int, double*, fftw_complex* );
+fftw_plan fft_plan_c2r( int, fftw_complex*, double* );
+void fft_destroy_plan( fftw_plan );
+void fft_exit( void );
+#endif
+
+
+#endif
+
+
+/* arch-tag: FFTW planning and wisdom (header) */
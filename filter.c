@@ -22,26 +22,61 @@
  */ 
 
 #include "filter.h"
+#include "noise.h"
+#include "fft.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef HAS_FFTW3
+#include <pthread.h>
+#endif
 
+/* Transform size of the FFT kernel; each transform yields this many
+ * outputs, less the filter length */
+#define FILTER_FFT_SIZE 1024
 
 
-/* Get the filter coefficients.  The user can choose between five different
-   standard windowed-FIR filter models.
+
+static const char* filter_names[] =
+{
+    "Blackman", "Bartlett", "Hanning", "Hamming", "Rectangular"
+};
+
+
+
+/* Get the filter coefficients, and describe the filter on stdout.
  */
 void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
+{
+    if( filter_type < BLACKMAN || filter_type > RECTANGULAR )
+    {
+        filter_type = BLACKMAN;
+    }
+    printf("\nFrequency cutoff:  %g*pi", cutoff);
+    printf("\nFilter is %s-windowed FIR lowpass, %d coefficients.\n",
+           filter_names[filter_type], M);
+    computeFilterCoeff( filter_type, filt, M, cutoff );
+}
+
+
+
+/* Compute the filter coefficients.  The user can choose between five
+   different standard windowed-FIR filter models.
+ */
+void computeFilterCoeff( int filter_type, double* filt, int M, double cutoff )
 {
     int i;
     double temp;
     double temp2;
 
-    printf("\nFrequency cutoff:  %g*pi", cutoff);
     cutoff *= M_PI;
     
     switch( filter_type )
     {
         case BARTLETT:
-            printf("\nFilter is Bartlett-windowed FIR lowpass, %d coefficients.\n", M);
             for(i=0; i<M; i++)
             {
                 temp = 2.0 * ((double)i)/((double)(M-1));        
@@ -66,7 +101,6 @@ void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
             break;
 
         case HANNING:
-            printf("\nFilter is Hanning-windowed FIR lowpass, %d coefficients.\n", M);
             for(i=0; i<M; i++)
             {
                 temp = ((double)i)/((double)(M-1));
@@ -84,7 +118,6 @@ void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
             break;
             
         case HAMMING:
-            printf("\nFilter is Hamming-windowed FIR lowpass, %d coefficients.\n", M);
             for(i=0; i<M; i++)
             {
                 temp = ((double)i)/((double)(M-1));
@@ -102,7 +135,6 @@ void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
             break;
             
         case RECTANGULAR:
-            printf("\nFilter is Rectangular-windowed FIR lowpass, %d coefficients.\n", M);
             for(i=0; i<M; i++)
             {
                 temp2 = ((double)i) - ((double)(M-1))/2.0;
@@ -120,7 +152,6 @@ void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
                                 
         default:
         case BLACKMAN:
-            printf("\nFilter is Blackman-windowed FIR lowpass, %d coefficients.\n", M);
             for(i=0; i<M; i++)
             {
                 temp = ((double)i)/((double)(M-1));
@@ -142,50 +173,499 @@ void getFilterCoeff( int filter_type, double* filt, int M, double cutoff )
 
 
 
-/* Filter the data with a previously computed FIR filter.
- * 'data' points to the data to be filtered, length 2*N
- * 'scratch' points to some workspace where the output will go, length N
- * 'N' is the number of samples taken as output from filter
- * 'filt' points to the filter coefficients
- * 'M' is the length of the filter 
+/* Convolve 'C' interleaved channels at once.  The innermost loop runs
+ * across the channels, which the compiler maps onto the lanes of a
+ * vector register when 'C' is a constant.
  */
-void filter( unsigned char* data, unsigned char* output, long N, 
-             double* filt, int M )
+static inline void filter_lanes( const unsigned char* data, unsigned char* output, long N,
+                                 double* filt, int M, const int C )
 {
     long n, k;
-    double sum;
-    
-    /* Convolve the first half of the input 'data' with the filter 'filt'. */
+    int c;
+    double sum[MAX_CHANNELS];
+    double h;
+    const unsigned char* x;
+
+    /* Convolve the input 'data' with the filter 'filt'. */
     for(n=M-1; n<N+M-1; n++)
     {
-        sum = 0.0;
+        for(c=0; c<C; c++)
+        {
+            sum[c] = 0.0;
+        }
         for(k=0; k<M; k++)
         {
-            sum += ((double)(*(data+n-k))) * (*(filt+k));
+            h = *(filt+k);
+            x = data + (n-k)*C;
+            for(c=0; c<C; c++)
+            {
+                sum[c] += ((double)(*(x+c))) * h;
+            }
+        }
+
+        for(c=0; c<C; c++)
+        {
+            /* Watch out for unsigned char overflow (clicking sounds) */
+            if( sum[c] > 255.0 )
+            {
+                sum[c] = 255.0;
+            }
+            else if( sum[c] < 0.0 )
+            {
+                sum[c] = 0.0;
+            }
+
+            *(output+(n-M+1)*C+c) = sum[c];
+        }
+    }
+}
+
+
+
+/* Filter the data with a previously computed FIR filter, in double
+ * precision.  This is the reference for the other kernels, which all
+ * take the same arguments:
+ * 'data' points to the data to be filtered, length N+M-1 frames
+ * 'output' points to some workspace where the output will go, length N frames
+ * 'N' is the number of frames of output
+ * 'C' is the number of interleaved channels in each frame
+ * 'filt' points to the filter coefficients
+ * 'M' is the length of the filter 
+ * Output frame 't' is the filter over input frames t .. t+M-1.
+ */
+static void filter_double( const unsigned char* data, unsigned char* output, long N, int C,
+                           double* filt, int M )
+{
+    switch( C )
+    {
+        case 1:
+            filter_lanes(data, output, N, filt, M, 1);
+            break;
+        case 2:
+            filter_lanes(data, output, N, filt, M, 2);
+            break;
+        case 4:
+            filter_lanes(data, output, N, filt, M, 4);
+            break;
+        case 8:
+            filter_lanes(data, output, N, filt, M, 8);
+            break;
+        default:
+            filter_lanes(data, output, N, filt, M, C);
+            break;
+    }
+}
+
+
+
+/* Fixed-point convolution over a flat array: output[p] is the sum over
+ * 'j' of data[p + j*stride] * h[j], shifted down by Q15_SHIFT and clamped
+ * to 0..255, for 'count' outputs.  With interleaved channels and 'stride'
+ * equal to the channel count, this filters every channel at once.
+ *
+ * The SSE2 version computes eight outputs at a time, interleaving the
+ * samples for two taps so that pmaddwd does two multiplies and an add per
+ * lane, and clamps with saturating packs instead of branches.  The scalar
+ * version does the identical integer arithmetic, for the outputs left over
+ * and for machines without SSE2.  Sums of up to a few thousand taps fit
+ * in 32 bits.
+ */
+void filter_fixed( const unsigned char* data, unsigned char* output, long count,
+                   int stride, const int16_t* h, int M )
+{
+    long p = 0;
+    int32_t sum;
+    int j;
+
+#ifdef __SSE2__
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo, hi, x, taps;
+        const unsigned char* d;
+
+        for (; p + 8 <= count; p += 8)
+        {
+            lo = _mm_setzero_si128();
+            hi = _mm_setzero_si128();
+            d = data + p;
+            for (j=0; j+1<M; j+=2, d += 2*stride)
+            {
+                taps = _mm_set1_epi32((uint16_t) h[j] | ((uint32_t) (uint16_t) h[j+1] << 16));
+                x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) d),
+                                      _mm_loadl_epi64((const __m128i *) (d + stride)));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi8(x, zero), taps));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), taps));
+            }
+            if (j < M)
+            {
+                /* Odd tap left over, paired with zero */
+                taps = _mm_set1_epi32((uint16_t) h[j]);
+                x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) d), zero);
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(x, zero), taps));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(x, zero), taps));
+            }
+
+            lo = _mm_srai_epi32(lo, Q15_SHIFT);
+            hi = _mm_srai_epi32(hi, Q15_SHIFT);
+            x  = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64((__m128i *) (output + p), _mm_packus_epi16(x, x));
+        }
+    }
+#endif
+
+    for (; p < count; p++)
+    {
+        sum = 0;
+        for (j=0; j<M; j++)
+        {
+            sum += (int32_t) data[p + j*stride] * h[j];
+        }
+        sum >>= Q15_SHIFT;
+        output[p] = sum > 255 ? 255 : (sum < 0 ? 0 : sum);
+    }
+}
+
+
+
+/* As filter_fixed(), for taps with h[j] == h[M-1-j].  The two samples
+ * under each pair of equal taps are added first, which halves the
+ * multiplies.  The integer sums are the same, so is the output. */
+static void filter_fixed_folded( const unsigned char* data, unsigned char* output,
+                                 long count, int stride, const int16_t* h, int M )
+{
+    long p = 0;
+    int32_t sum;
+    int j, half = M / 2;
+
+#ifdef __SSE2__
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo, hi, s0, s1, taps;
+        const unsigned char* d;
+
+#define FOLD(j) _mm_add_epi16( \
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (d + (j)*stride)), zero), \
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (d + (M-1-(j))*stride)), zero))
+
+        for (; p + 8 <= count; p += 8)
+        {
+            lo = _mm_setzero_si128();
+            hi = _mm_setzero_si128();
+            d = data + p;
+            for (j=0; j+1<half; j+=2)
+            {
+                taps = _mm_set1_epi32((uint16_t) h[j] | ((uint32_t) (uint16_t) h[j+1] << 16));
+                s0 = FOLD(j);
+                s1 = FOLD(j+1);
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), taps));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), taps));
+            }
+            if (j < half)
+            {
+                taps = _mm_set1_epi32((uint16_t) h[j]);
+                s0 = FOLD(j);
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(s0, zero), taps));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(s0, zero), taps));
+            }
+            if (M & 1)
+            {
+                /* The middle tap has no partner */
+                taps = _mm_set1_epi32((uint16_t) h[half]);
+                s0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (d + half*stride)),
+                                       zero);
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(s0, zero), taps));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(s0, zero), taps));
+            }
+
+            lo = _mm_srai_epi32(lo, Q15_SHIFT);
+            hi = _mm_srai_epi32(hi, Q15_SHIFT);
+            s0 = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64((__m128i *) (output + p), _mm_packus_epi16(s0, s0));
         }
-        
-        /* Watch out for unsigned char overflow (clicking sounds) */
-        if( sum > 255.0 )
+#undef FOLD
+    }
+#endif
+
+    for (; p < count; p++)
+    {
+        sum = 0;
+        for (j=0; j<half; j++)
         {
-            sum = 255.0;
+            sum += ((int32_t) data[p + j*stride] + data[p + (M-1-j)*stride]) * h[j];
         }
-        else if( sum < 0.0 )
+        if (M & 1)
         {
-            sum = 0.0;
+            sum += (int32_t) data[p + half*stride] * h[half];
         }
-        
-        
-        *(output+n-M+1) = sum;                   
+        sum >>= Q15_SHIFT;
+        output[p] = sum > 255 ? 255 : (sum < 0 ? 0 : sum);
     }
-    
-    /* Copy the second half of 'data' over the first half.  This will
-     * ensure continuity of the convolution even though it is broken up
-     * into two-second blocks.
-     */
-    for(n=0; n<N; n++)
+}
+
+
+
+/* Quantize 'M' taps to Q15 for filter_fixed(), reversing them so that
+ * both data and taps run forwards */
+void filter_taps_q15( const double* filt, int M, int16_t* h )
+{
+    double q;
+    int j;
+
+    for (j=0; j<M; j++)
+    {
+        q = filt[M-1-j] * (1 << Q15_SHIFT);
+        q = q >= 0.0 ? q + 0.5 : q - 0.5;
+        if (q > INT16_MAX)
+        {
+            q = INT16_MAX;
+        }
+        else if (q < INT16_MIN)
+        {
+            q = INT16_MIN;
+        }
+        h[j] = (int16_t) q;
+    }
+}
+
+
+
+/* The same filter in 16-bit fixed point.  The samples are only 8 bits,
+ * so Q15 coefficients lose nothing audible: the output is at most 1 LSB
+ * away from the double precision result.
+ */
+static void filter_q15( const unsigned char* data, unsigned char* output, long N, int C,
+                        double* filt, int M )
+{
+    int16_t h[MAX_FILTER_LEN];
+
+    filter_taps_q15(filt, M, h);
+    filter_fixed(data, output, N*C, C, h, M);
+}
+
+
+
+/* The fixed-point filter, folded.  The windowed lowpass filters are
+ * symmetric, but the rounding of the window can leave a pair of taps a
+ * step apart once quantized; those filters are run unfolded. */
+static void filter_folded( const unsigned char* data, unsigned char* output, long N, int C,
+                           double* filt, int M )
+{
+    int16_t h[MAX_FILTER_LEN];
+    int j;
+
+    filter_taps_q15(filt, M, h);
+    for (j=0; j<M/2 && h[j] == h[M-1-j]; j++)
+    {
+    }
+    if (j < M/2)
+    {
+        filter_fixed(data, output, N*C, C, h, M);
+    }
+    else
+    {
+        filter_fixed_folded(data, output, N*C, C, h, M);
+    }
+}
+
+
+
+#ifdef HAS_FFTW3
+
+static pthread_mutex_t fft_lock = PTHREAD_MUTEX_INITIALIZER;
+static fftw_plan fft_forward = NULL, fft_inverse = NULL;
+static int fft_failed = 0;
+
+
+/* The plans are shared; each call transforms its own arrays */
+static int filter_fft_plans( void )
+{
+    double* x;
+    fftw_complex* X;
+
+    pthread_mutex_lock(&fft_lock);
+    if (fft_forward == NULL && !fft_failed)
+    {
+        x = (double *) fftw_malloc(FILTER_FFT_SIZE * sizeof(double));
+        X = (fftw_complex *) fftw_malloc((FILTER_FFT_SIZE/2 + 1) * sizeof(fftw_complex));
+        if (x != NULL && X != NULL)
+        {
+            fft_forward = fft_plan_r2c(FILTER_FFT_SIZE, x, X);
+            fft_inverse = fft_plan_c2r(FILTER_FFT_SIZE, X, x);
+        }
+        fft_failed = (fft_forward == NULL || fft_inverse == NULL);
+        if (x != NULL) fftw_free(x);
+        if (X != NULL) fftw_free(X);
+    }
+    pthread_mutex_unlock(&fft_lock);
+    return fft_failed ? -1 : 0;
+}
+
+
+
+/* Overlap-save convolution in double precision, one channel at a time.
+ * Each transform of FILTER_FFT_SIZE samples gives that many outputs, less
+ * the M-1 which wrap around.  It is cheaper than the direct form only for
+ * long filters; the result differs from it by rounding alone. */
+static void filter_fft( const unsigned char* data, unsigned char* output, long N, int C,
+                        double* filt, int M )
+{
+    _Alignas(64) double x[FILTER_FFT_SIZE];
+    _Alignas(64) fftw_complex X[FILTER_FFT_SIZE/2 + 1];
+    _Alignas(64) fftw_complex H[FILTER_FFT_SIZE/2 + 1];
+    long start, n, i, step = FILTER_FFT_SIZE - (M-1);
+    double re, sum;
+    int c, k;
+
+    if (filter_fft_plans() < 0)
+    {
+        filter_double(data, output, N, C, filt, M);
+        return;
+    }
+
+    /* The filter's spectrum, scaled for the unnormalized inverse */
+    for (k=0; k<FILTER_FFT_SIZE; k++)
+    {
+        x[k] = k < M ? filt[k] / FILTER_FFT_SIZE : 0.0;
+    }
+    fftw_execute_dft_r2c(fft_forward, x, H);
+
+    for (c=0; c<C; c++)
+    {
+        for (start=0; start<N; start+=step)
+        {
+            n = N - start < step ? N - start : step;
+            for (i=0; i<n+M-1; i++)
+            {
+                x[i] = data[(start+i)*C + c];
+            }
+            for (; i<FILTER_FFT_SIZE; i++)
+            {
+                x[i] = 0.0;
+            }
+
+            fftw_execute_dft_r2c(fft_forward, x, X);
+            for (k=0; k<FILTER_FFT_SIZE/2 + 1; k++)
+            {
+                re      = X[k][0]*H[k][0] - X[k][1]*H[k][1];
+                X[k][1] = X[k][0]*H[k][1] + X[k][1]*H[k][0];
+                X[k][0] = re;
+            }
+            fftw_execute_dft_c2r(fft_inverse, X, x);
+
+            for (i=0; i<n; i++)
+            {
+                sum = x[i + M-1];
+                sum = sum > 255.0 ? 255.0 : (sum < 0.0 ? 0.0 : sum);
+                output[(start+i)*C + c] = sum;
+            }
+        }
+    }
+}
+
+#endif /* HAS_FFTW3 */
+
+
+
+/* Set up ahead of time whatever the kernels make on first use, so that
+ * none of them allocates once running in the audio path: every kernel if
+ * 'all' is set, as when the choice may change while playing, or else just
+ * the selected one. */
+void filter_init( int all )
+{
+#ifdef HAS_FFTW3
+    if (all || strcmp(filter_selected()->name, "fft") == 0)
+    {
+        filter_fft_plans();
+    }
+#endif
+}
+
+
+
+/* Release what the kernels have set up.  FFTW needs this before
+ * fft_exit(). */
+void filter_exit( void )
+{
+#ifdef HAS_FFTW3
+    pthread_mutex_lock(&fft_lock);
+    if (fft_forward != NULL)
+    {
+        fft_destroy_plan(fft_forward);
+    }
+    if (fft_inverse != NULL)
+    {
+        fft_destroy_plan(fft_inverse);
+    }
+    fft_forward = fft_inverse = NULL;
+    fft_failed  = 0;
+    pthread_mutex_unlock(&fft_lock);
+#endif
+}
+
+
+
+/* The first entry is the reference, the one kept bit-exact */
+const filter_kernel filter_kernels[] =
+{
+    { "double", filter_double, 0, 0 },
+    { "q15",    filter_q15,    1, 1 },
+    { "folded", filter_folded, 1, 1 },
+#ifdef HAS_FFTW3
+    { "fft",    filter_fft,    1, 0 },
+#endif
+    { NULL, NULL, 0, 0 }
+};
+
+/* Fixed point is faster, and its error is below what 8-bit output can
+ * resolve anyway */
+#define FILTER_AUTO_KERNEL 1
+
+static _Atomic(const filter_kernel*) filter_current = &filter_kernels[FILTER_AUTO_KERNEL];
+
+
+
+/* Choose the kernel used by filter(), by name or "auto".  Returns -1 if
+ * there is no such kernel. */
+int filter_select( const char* name )
+{
+    const filter_kernel* kernel;
+
+    if (strcmp(name, "auto") == 0)
     {
-        *(data+n) = *(data+n+N);
+        atomic_store(&filter_current, &filter_kernels[FILTER_AUTO_KERNEL]);
+        return 0;
+    }
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        if (strcmp(kernel->name, name) == 0)
+        {
+            atomic_store(&filter_current, kernel);
+            return 0;
+        }
     }
+    return -1;
+}
+
+
+
+const filter_kernel* filter_selected( void )
+{
+    return atomic_load(&filter_current);
+}
+
+
+
+/* Filter 'N' frames of 'data' into 'output' with the selected kernel.
+ * 'data' holds 2*N frames, and its second half is then copied over the
+ * first, as the history for the next block.  This ensures continuity of
+ * the convolution even though it is broken up into blocks.  See
+ * filter_double() for the other arguments.
+ */
+void filter( unsigned char* data, unsigned char* output, long N, int C,
+             double* filt, int M )
+{
+    atomic_load(&filter_current)->run(data, output, N, C, filt, M);
+    memcpy(data, data + N*C, N*C);
 }
 
 
@@ -20,6 +20,7 @@
 #define FILTER_H 1
 
 #include <math.h>
+#include <stdint.h>
 
 #define BLACKMAN    0
 #define BARTLETT    1
@@ -27,8 +28,36 @@
 #define HAMMING     3
 #define RECTANGULAR 4
 
-void filter( unsigned char*, unsigned char*, long, double*, int );
+#define MAX_FILTER_LEN 100
+
+/* Fractional bits of fixed-point coefficients */
+#define Q15_SHIFT 15
+
+/* One implementation of the convolution; see filter_double() for the
+ * arguments.  'tolerance' is how far, in LSBs, its output may stray from
+ * the straightforward double precision result.  'exact' marks kernels
+ * whose output is identical to that of the default one, so that any of
+ * them can play a seeded stream. */
+typedef struct
+{
+    const char* name;
+    void (*run)( const unsigned char*, unsigned char*, long, int, double*, int );
+    int tolerance;
+    int exact;
+} filter_kernel;
+
+/* Terminated by an entry with a NULL name */
+extern const filter_kernel filter_kernels[];
+
+int  filter_select( const char* );
+const filter_kernel* filter_selected( void );
+void filter( unsigned char*, unsigned char*, long, int, double*, int );
 void getFilterCoeff( int, double *, int, double );
+void computeFilterCoeff( int, double *, int, double );
+void filter_fixed( const unsigned char*, unsigned char*, long, int, const int16_t*, int );
+void filter_taps_q15( const double*, int, int16_t* );
+void filter_init( int );
+void filter_exit( void );
 
 
 #endif
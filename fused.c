@@ -0,0 +1,156 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* fused.c
+ * Renders filtered noise in a single pass over small tiles.  Each tile of
+ * new noise is generated, faded if need be, and convolved straight into
+ * the output while it is still in the L1 cache, so the noise never makes
+ * a round trip through memory.  Only the last FUSED_HISTORY frames are
+ * carried from one tile to the next, instead of a whole block.
+ *
+ * Each tile is filtered by the selected kernel, or the generator's own if
+ * it has one, so the output is the same as that of filter(): the same seed
+ * gives the same stream, frame for frame.  Only a fade differs slightly,
+ * since it applies to the noise as it is generated, which here is later
+ * than with filter()'s block of lookahead.  Since the history is plain
+ * noise, the kernel may change between calls.
+ */
+
+#include <string.h>
+#include "fused.h"
+
+
+
+/* Start a stream from 'noise', for a filter of 'M' taps.  Output frame 't'
+ * is the filter over noise frames t .. t+M-1, as with filter(). */
+void fused_init( fused_gen* f, noise_gen* noise, int M )
+{
+    int C = noise->channels;
+
+    f->channels = C;
+    f->tile     = FUSED_TILE_BYTES / C;
+    f->kernel   = NULL;
+
+    /* Silence before the start, for filters lengthened later */
+    memset(f->buffer, 128, (FUSED_HISTORY - (M-1)) * C);
+    noise_fill(noise, f->buffer + (FUSED_HISTORY - (M-1)) * C, M-1);
+}
+
+
+
+/* Render 'frames' frames into 'out', filtered with the 'M' taps 'filt'.
+ * If 'level' is not NULL, the noise is faded as with fade_block() before
+ * it is filtered. */
+void fused_render( fused_gen* f, noise_gen* noise, unsigned char* out, long frames,
+                   double* filt, int M, double* level, double step )
+{
+    fused_render_within(f, noise, out, frames, filt, M, M, level, step);
+}
+
+
+
+/* As fused_render(), but with a filter of 'm' taps centred where one of
+ * 'M' would be, so that output from the two lines up */
+void fused_render_within( fused_gen* f, noise_gen* noise, unsigned char* out, long frames,
+                          double* filt, int m, int M, double* level, double step )
+{
+    const filter_kernel* kernel = f->kernel != NULL ? f->kernel : filter_selected();
+    int C = f->channels;
+    unsigned char* fresh = f->buffer + FUSED_HISTORY * C;
+    unsigned char* data  = fresh - (M-1 - (M-m)/2) * C;
+    long n;
+
+    while (frames > 0)
+    {
+        n = frames < f->tile ? frames : f->tile;
+
+        noise_fill(noise, fresh, n);
+        if (level != NULL)
+        {
+            fade_block(fresh, fresh, n, C, level, step);
+        }
+        kernel->run(data, out, n, C, filt, m);
+
+        /* The newest frames are the history for the next tile */
+        memmove(f->buffer, f->buffer + n * C, FUSED_HISTORY * C);
+        out    += n * C;
+        frames -= n;
+    }
+}
+
+
+
+/* Render 'frames' frames of unfiltered noise into 'out', for a filter
+ * applied afterwards, from 'delay' frames behind the newest.  The history
+ * is kept up to date, so that filtering can resume seamlessly. */
+void fused_raw( fused_gen* f, noise_gen* noise, unsigned char* out, long frames,
+                int delay, double* level, double step )
+{
+    int C = f->channels;
+    unsigned char* fresh = f->buffer + FUSED_HISTORY * C;
+    long n;
+
+    while (frames > 0)
+    {
+        n = frames < f->tile ? frames : f->tile;
+
+        noise_fill(noise, fresh, n);
+        if (level != NULL)
+        {
+            fade_block(fresh, fresh, n, C, level, step);
+        }
+        memcpy(out, fresh - delay * C, n * C);
+
+        memmove(f->buffer, f->buffer + n * C, FUSED_HISTORY * C);
+        out    += n * C;
+        frames -= n;
+    }
+}
+
+
+
+/* Scale 'frames' frames of 'in' towards silence into 'out', starting at
+ * '*level' and stepping down by 'step' each frame */
+void fade_block( unsigned char* out, const unsigned char* in, int frames,
+                 int channels, double* level, double step )
+{
+    double ddata;
+    int i, c;
+
+    for (i = 0; i < frames; i++)
+    {
+        for (c = 0; c < channels; c++)
+        {
+            ddata = (double) in[i*channels + c];
+            ddata -= 128.0;
+            ddata *= *level;
+            ddata += 128.0;
+
+            out[i*channels + c] = (unsigned char) ddata;
+        }
+        *level -= step;
+        if (*level < 0.0)
+        {
+            *level = 0.0;
+        }
+    }
+}
+
+
+/* arch-tag: fused noise rendering */
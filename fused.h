@@ -0,0 +1,52 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef FUSED_H
+#define FUSED_H 1
+
+#include "filter.h"
+#include "noise.h"
+
+/* Bytes of new noise per tile.  With the history in front of it, a tile
+ * stays well inside the L1 cache for any channel count. */
+#define FUSED_TILE_BYTES 4096
+
+/* Frames carried over between tiles, enough for the longest filter */
+#define FUSED_HISTORY (MAX_FILTER_LEN - 1)
+
+typedef struct
+{
+    int channels;
+    long tile;                          /* frames of new noise per tile */
+    const filter_kernel* kernel;        /* or NULL for the selected one */
+    _Alignas(64) unsigned char buffer[FUSED_HISTORY * MAX_CHANNELS + FUSED_TILE_BYTES];
+} fused_gen;
+
+void fused_init( fused_gen*, noise_gen*, int );
+void fused_render( fused_gen*, noise_gen*, unsigned char*, long, double*, int,
+                   double*, double );
+void fused_render_within( fused_gen*, noise_gen*, unsigned char*, long, double*, int,
+                          int, double*, double );
+void fused_raw( fused_gen*, noise_gen*, unsigned char*, long, int, double*, double );
+void fade_block( unsigned char*, const unsigned char*, int, int, double*, double );
+
+
+#endif
+
+
+/* arch-tag: fused noise rendering (header) */
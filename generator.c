@@ -0,0 +1,268 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* generator.c
+ * The noise generator packaged as libwhitenoise.  A generator holds its
+ * own random lanes, tile history and filter, so instances share nothing.
+ * Updates are computed by the caller and handed over under a lock which
+ * the renderer only ever tries: if it is busy, the change is picked up by
+ * the next render instead.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "generator.h"
+#include "filter.h"
+#include "fused.h"
+#include "noise.h"
+
+#define WN_EXPORT __attribute__((visibility("default")))
+
+/* Frames rendered at a time before conversion */
+#define WN_BLOCK 1024
+
+_Static_assert(WN_BLACKMAN == BLACKMAN && WN_RECTANGULAR == RECTANGULAR,
+               "window numbers differ from filter.h");
+_Static_assert(WN_MAX_CHANNELS == MAX_CHANNELS && WN_MAX_FILTER_LEN == MAX_FILTER_LEN,
+               "limits differ from filter.h and noise.h");
+
+
+struct wn_generator
+{
+    fused_gen tiles;        /* first, for its alignment */
+    noise_gen noise;
+    int channels;
+    uint64_t seed;
+
+    /* Filter in use, owned by the renderer */
+    const filter_kernel* kernel;
+    double coeff[MAX_FILTER_LEN];
+    int length;
+
+    /* Filter waiting to be picked up, guarded by 'lock' */
+    pthread_mutex_t lock;
+    atomic_int changed;
+    const filter_kernel* nextKernel;
+    double nextCoeff[MAX_FILTER_LEN];
+    int nextLength;
+
+    unsigned char block[WN_BLOCK * MAX_CHANNELS];
+};
+
+
+
+WN_EXPORT void wn_params_default(wn_params* p)
+{
+    memset(p, 0, sizeof(wn_params));
+    p->channels = 1;
+    p->cutoff   = 0.3;
+    p->filter   = WN_BLACKMAN;
+    p->length   = 25;
+}
+
+
+
+/* The kernel named in 'p', or NULL if it cannot be used here.  The FFT
+ * kernel keeps process-wide FFTW plans and wisdom, so it is left to the
+ * whitenoise program. */
+static const filter_kernel* wn_kernel(const wn_params* p)
+{
+    const filter_kernel* kernel;
+    const char* name = p->kernel != NULL ? p->kernel : "q15";
+
+    if (strcmp(name, "fft") == 0)
+    {
+        return NULL;
+    }
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        if (strcmp(kernel->name, name) == 0)
+        {
+            return kernel;
+        }
+    }
+    return NULL;
+}
+
+
+
+/* Check 'p', and work out its filter.  Returns -1 with errno EINVAL if it
+ * is out of range. */
+static int wn_design(const wn_params* p, const filter_kernel** kernel, double* coeff)
+{
+    if (p->channels < 1 || p->channels > MAX_CHANNELS ||
+        !(p->cutoff > 0.0 && p->cutoff < 1.0) ||
+        p->filter < BLACKMAN || p->filter > RECTANGULAR ||
+        p->length < 1 || p->length > MAX_FILTER_LEN ||
+        (*kernel = wn_kernel(p)) == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    computeFilterCoeff(p->filter, coeff, p->length, p->cutoff);
+    return 0;
+}
+
+
+
+WN_EXPORT wn_generator* wn_generator_create(const wn_params* p)
+{
+    wn_generator* g;
+    void* mem;
+    int err;
+
+    if ((err = posix_memalign(&mem, 64, sizeof(wn_generator))) != 0)
+    {
+        errno = err;
+        return NULL;
+    }
+    g = (wn_generator *) mem;
+    memset(g, 0, sizeof(wn_generator));
+
+    if (wn_design(p, &g->kernel, g->coeff) < 0)
+    {
+        free(g);
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((err = pthread_mutex_init(&g->lock, NULL)) != 0)
+    {
+        free(g);
+        errno = err;
+        return NULL;
+    }
+    g->channels = p->channels;
+    g->seed     = p->seed;
+    g->length   = p->length;
+    atomic_init(&g->changed, 0);
+
+    noise_init(&g->noise, g->seed, g->channels);
+    fused_init(&g->tiles, &g->noise, g->length);
+    return g;
+}
+
+
+
+/* Change the filter.  The channel count and seed cannot change. */
+WN_EXPORT int wn_generator_update(wn_generator* g, const wn_params* p)
+{
+    const filter_kernel* kernel;
+    double coeff[MAX_FILTER_LEN];
+
+    if (p->channels != g->channels || p->seed != g->seed ||
+        wn_design(p, &kernel, coeff) < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&g->lock);
+    g->nextKernel = kernel;
+    g->nextLength = p->length;
+    memcpy(g->nextCoeff, coeff, p->length * sizeof(double));
+    atomic_store(&g->changed, 1);
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+
+
+/* Take up an update, unless one is being written right now */
+static void wn_pick_up(wn_generator* g)
+{
+    if (!atomic_load_explicit(&g->changed, memory_order_relaxed) ||
+        pthread_mutex_trylock(&g->lock) != 0)
+    {
+        return;
+    }
+    g->kernel = g->nextKernel;
+    g->length = g->nextLength;
+    memcpy(g->coeff, g->nextCoeff, g->length * sizeof(double));
+    atomic_store_explicit(&g->changed, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&g->lock);
+}
+
+
+
+/* Render 'frames' frames of unsigned 8-bit noise into 'out', centred on
+ * 128.  Returns the number of frames. */
+WN_EXPORT long wn_generator_render_uint8(wn_generator* g, unsigned char* out, long frames)
+{
+    wn_pick_up(g);
+    g->tiles.kernel = g->kernel;
+    fused_render(&g->tiles, &g->noise, out, frames, g->coeff, g->length, NULL, 0.0);
+    return frames;
+}
+
+
+
+/* Render 'frames' frames into 'out', in [-1, 1) */
+WN_EXPORT long wn_generator_render_float(wn_generator* g, float* out, long frames)
+{
+    int C = g->channels;
+    long done, n, i;
+
+    for (done = 0; done < frames; done += n)
+    {
+        n = frames - done < WN_BLOCK ? frames - done : WN_BLOCK;
+        wn_generator_render_uint8(g, g->block, n);
+        for (i=0; i<n*C; i++)
+        {
+            out[done*C + i] = ((int) g->block[i] - 128) * (1.0f / 128.0f);
+        }
+    }
+    return frames;
+}
+
+
+
+/* Render 'frames' frames into 'out', as signed 16-bit */
+WN_EXPORT long wn_generator_render_int16(wn_generator* g, int16_t* out, long frames)
+{
+    int C = g->channels;
+    long done, n, i;
+
+    for (done = 0; done < frames; done += n)
+    {
+        n = frames - done < WN_BLOCK ? frames - done : WN_BLOCK;
+        wn_generator_render_uint8(g, g->block, n);
+        for (i=0; i<n*C; i++)
+        {
+            out[done*C + i] = (int16_t) (((int) g->block[i] - 128) * 256);
+        }
+    }
+    return frames;
+}
+
+
+
+WN_EXPORT void wn_generator_destroy(wn_generator* g)
+{
+    if (g != NULL)
+    {
+        pthread_mutex_destroy(&g->lock);
+        free(g);
+    }
+}
+
+
+/* arch-tag: embeddable noise generator */
@@ -0,0 +1,86 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef GENERATOR_H
+#define GENERATOR_H 1
+
+#include <stdint.h>
+
+/* The noise generator of whitenoise, as a library for hosting in another
+ * program's audio callbacks.  Each generator is independent, with its own
+ * random sequence and filter, so any number can run in any threads.  One
+ * thread renders from a generator; any thread may update it meanwhile,
+ * and the change is picked up by a later render without the renderer ever
+ * waiting.  Rendering never allocates.
+ *
+ *     wn_params p;
+ *     wn_generator* g;
+ *
+ *     wn_params_default(&p);
+ *     p.channels = 2;
+ *     g = wn_generator_create(&p);
+ *     ...
+ *     wn_generator_render_float(g, out, frames);    (in the callback)
+ *     ...
+ *     p.cutoff = 0.1;
+ *     wn_generator_update(g, &p);                   (from anywhere)
+ *     ...
+ *     wn_generator_destroy(g);
+ *
+ * Functions return -1 (or NULL) and set errno on failure, and never print.
+ * The noise is the 8-bit signal whitenoise plays, scaled to full range:
+ * with the same seed and options it is the same as "whitenoise --seed".
+ */
+
+/* Filter windows, as for -F */
+#define WN_BLACKMAN    0
+#define WN_BARTLETT    1
+#define WN_HANNING     2
+#define WN_HAMMING     3
+#define WN_RECTANGULAR 4
+
+#define WN_MAX_CHANNELS   8
+#define WN_MAX_FILTER_LEN 100
+
+
+typedef struct
+{
+    int channels;           /* fixed once created */
+    uint64_t seed;          /* fixed once created */
+    double cutoff;          /* as a fraction of pi, in (0, 1) */
+    int filter;             /* one of the WN_ windows */
+    int length;             /* filter taps, up to WN_MAX_FILTER_LEN */
+    const char* kernel;     /* "q15", "folded" or "double"; NULL for q15 */
+} wn_params;
+
+typedef struct wn_generator wn_generator;
+
+
+void wn_params_default( wn_params* );
+wn_generator* wn_generator_create( const wn_params* );
+int  wn_generator_update( wn_generator*, const wn_params* );
+long wn_generator_render_float( wn_generator*, float*, long );
+long wn_generator_render_int16( wn_generator*, int16_t*, long );
+long wn_generator_render_uint8( wn_generator*, unsigned char*, long );
+void wn_generator_destroy( wn_generator* );
+
+
+#endif
+
+
+/* arch-tag: embeddable noise generator (header) */
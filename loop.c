@@ -0,0 +1,442 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* loop.c
+ * Renders a long block of filtered noise once, in a background thread, and
+ * plays it back repeatedly.  The end of each loop is crossfaded over its
+ * start, so the seam is inaudible and the audio thread only has to hand
+ * pointers to the sound card.  Finished loops are kept in the on-disk
+ * cache, so the next start with the same settings can play at once.
+ *
+ * The audio thread never allocates, frees or touches the disk: looking up
+ * the cache happens in the renderer, and loops the audio thread is done
+ * with are handed back to the renderer to free.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "loop.h"
+#include "cache.h"
+#include "rt.h"
+#include "render.h"
+
+
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+
+static void loop_free(noise_loop* loop)
+{
+    if (loop != NULL)
+    {
+        if (loop->map != NULL)
+        {
+            cache_unmap(loop->map, loop->mapSize);
+        }
+        else
+        {
+            free(loop->samples);
+        }
+        free(loop);
+    }
+}
+
+
+/* Free the loops handed back by the audio thread.  Called with the lock
+ * held, which is released meanwhile. */
+static void loop_reap(loop_player* player)
+{
+    noise_loop* loop;
+    noise_loop* next;
+
+    loop = player->retired;
+    player->retired = NULL;
+    pthread_mutex_unlock(&player->lock);
+
+    for (; loop != NULL; loop = next)
+    {
+        next = loop->next;
+        loop_free(loop);
+    }
+    pthread_mutex_lock(&player->lock);
+}
+
+
+
+/* Hand a loop the audio thread is done with to the renderer */
+static void loop_retire(loop_player* player, noise_loop* loop)
+{
+    if (loop == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&player->lock);
+    loop->next = player->retired;
+    player->retired = loop;
+    pthread_cond_signal(&player->wake);
+    pthread_mutex_unlock(&player->lock);
+}
+
+
+
+/* Map the loop for 'key' from the cache, if it is there */
+static noise_loop* loop_cached(loop_player* player, uint64_t key, long length)
+{
+    noise_loop* loop;
+
+    if ((loop = (noise_loop *) malloc(sizeof(noise_loop))) == NULL)
+    {
+        return NULL;
+    }
+    loop->length  = length;
+    loop->samples = cache_map(key, length * player->channels, &loop->map, &loop->mapSize);
+    if (loop->samples == NULL)
+    {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+
+
+/* The render a cancellation check belongs to */
+typedef struct
+{
+    loop_player* player;
+    int generation;
+} loop_job;
+
+
+/* A render in progress is abandoned when the player shuts down or when
+ * newer parameters arrive. */
+static int loop_interrupted(void* arg)
+{
+    loop_job* job = (loop_job *) arg;
+    int interrupted;
+
+    pthread_mutex_lock(&job->player->lock);
+    interrupted = !job->player->running || job->player->generation != job->generation;
+    pthread_mutex_unlock(&job->player->lock);
+
+    return interrupted;
+}
+
+
+/* Render 'length' samples of filtered noise, followed by 'fade' more which
+ * are crossfaded back over the start of the loop.  The last sample of the
+ * loop is then followed naturally by the first.  The rendering is spread
+ * over all cores. */
+static noise_loop* loop_render(loop_player* player, int generation,
+        double* coeff, int M, long length, long fade, noise_gen* noise)
+{
+    noise_loop* loop = NULL;
+    unsigned char* rendered = NULL;
+    int C = player->channels;
+    loop_job job;
+    long i;
+    double t, sum;
+
+    if ((loop = (noise_loop *) malloc(sizeof(noise_loop))) == NULL ||
+        (rendered = (unsigned char *) malloc((length + fade) * C)) == NULL)
+    {
+        goto fail;
+    }
+
+    job.player     = player;
+    job.generation = generation;
+    if (render_noise(noise, rendered, length + fade, coeff, M, 0,
+                     loop_interrupted, &job) < 0)
+    {
+        goto fail;
+    }
+
+    /* The head and tail are uncorrelated, so use an equal-power fade. */
+    for (i=0; i<fade*C; i++)
+    {
+        t = 0.5 * M_PI * ((double) (i/C) + 0.5) / ((double) fade);
+        sum = 128.0 + ((double) rendered[i] - 128.0) * sin(t) +
+                      ((double) rendered[length*C+i] - 128.0) * cos(t);
+        if (sum > 255.0)
+        {
+            sum = 255.0;
+        }
+        else if (sum < 0.0)
+        {
+            sum = 0.0;
+        }
+        rendered[i] = sum;
+    }
+
+    loop->samples = rendered;
+    loop->length  = length;
+    loop->map     = NULL;
+    loop->mapSize = 0;
+    return loop;
+
+fail:
+    free(loop);
+    free(rendered);
+    return NULL;
+}
+
+
+static void* loop_worker(void* arg)
+{
+    loop_player* player = (loop_player *) arg;
+    double coeff[MAX_FILTER_LEN];
+    int M, rate, generation;
+    long length;
+    uint64_t key;
+    noise_gen noise;
+    noise_loop* loop;
+
+    rt_demote();
+    noise_init(&noise, player->seed, player->channels);
+
+    pthread_mutex_lock(&player->lock);
+    while (player->running)
+    {
+        if (player->retired != NULL)
+        {
+            loop_reap(player);
+            continue;
+        }
+        if (!player->pending)
+        {
+            pthread_cond_wait(&player->wake, &player->lock);
+            continue;
+        }
+        M          = player->filterLength;
+        rate       = player->rate;
+        generation = player->generation;
+        key        = player->key;
+        memcpy(coeff, player->coeff, M * sizeof(double));
+        player->pending = 0;
+        pthread_mutex_unlock(&player->lock);
+
+        length = ((long) player->seconds) * rate;
+        if (player->seeded)
+        {
+            noise_init(&noise, player->seed, player->channels);
+            loop = NULL;
+        }
+        else
+        {
+            loop = loop_cached(player, key, length);
+        }
+        if (loop == NULL)
+        {
+            loop = loop_render(player, generation, coeff, M, length,
+                    MIN(rate / 2, length / 2), &noise);
+            if (loop != NULL && !player->seeded &&
+                cache_store(key, loop->samples, loop->length * player->channels) < 0)
+            {
+                fprintf(stderr, "Warning: could not save loop to the cache.\n");
+            }
+        }
+
+        pthread_mutex_lock(&player->lock);
+        if (loop != NULL && generation == player->generation)
+        {
+            loop_free(player->ready);
+            player->ready = loop;
+        }
+        else
+        {
+            loop_free(loop);
+        }
+    }
+    pthread_mutex_unlock(&player->lock);
+
+    return NULL;
+}
+
+
+
+/* Start the background renderer.  Loops will be 'seconds' long, with
+ * 'channels' interleaved channels, made from noise seeded with 'seed'.
+ * If 'seeded' is set, every loop starts again from that seed. */
+int loop_init(loop_player* player, int seconds, int channels, int seeded, uint64_t seed)
+{
+    memset(player, 0, sizeof(loop_player));
+    player->seconds  = seconds;
+    player->channels = channels;
+    player->seeded   = seeded;
+    player->seed     = seed;
+    player->running = 1;
+
+    pthread_mutex_init(&player->lock, NULL);
+    pthread_cond_init(&player->wake, NULL);
+
+    if (pthread_create(&player->thread, NULL, loop_worker, player) != 0)
+    {
+        pthread_mutex_destroy(&player->lock);
+        pthread_cond_destroy(&player->wake);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/* Stop the renderer and release all loops */
+void loop_exit(loop_player* player)
+{
+    pthread_mutex_lock(&player->lock);
+    player->running = 0;
+    pthread_cond_signal(&player->wake);
+    pthread_mutex_unlock(&player->lock);
+
+    pthread_join(player->thread, NULL);
+
+    /* Loops retired after the renderer's last look */
+    pthread_mutex_lock(&player->lock);
+    loop_reap(player);
+    pthread_mutex_unlock(&player->lock);
+    pthread_mutex_destroy(&player->lock);
+    pthread_cond_destroy(&player->wake);
+    loop_free(player->ready);
+    loop_free(player->current);
+    loop_free(player->previous);
+}
+
+
+
+/* Ask for a new loop with the given filter.  The renderer maps it from
+ * the cache if it can, or renders it otherwise; the current loop keeps
+ * playing until it is ready. */
+void loop_request(loop_player* player, double* coeff, int M, int rate)
+{
+    uint64_t key;
+
+    key = cache_key(coeff, M, rate, player->channels, ((long) player->seconds) * rate);
+
+    pthread_mutex_lock(&player->lock);
+    player->generation++;
+    memcpy(player->coeff, coeff, M * sizeof(double));
+    player->filterLength = M;
+    player->rate         = rate;
+    player->key          = key;
+    player->pending      = 1;
+    pthread_cond_signal(&player->wake);
+    pthread_mutex_unlock(&player->lock);
+}
+
+
+
+/* Pick up a newly rendered loop, if there is one.  Returns nonzero once a
+ * loop is available for playback. */
+int loop_update(loop_player* player)
+{
+    noise_loop* loop;
+
+    pthread_mutex_lock(&player->lock);
+    loop = player->ready;
+    player->ready = NULL;
+    pthread_mutex_unlock(&player->lock);
+
+    if (loop != NULL)
+    {
+        if (player->current != NULL)
+        {
+            /* Interrupting a crossfade just drops its oldest loop */
+            loop_retire(player, player->previous);
+            player->previous     = player->current;
+            player->prevPosition = player->position;
+            player->fadePosition = 0;
+        }
+        player->current  = loop;
+        player->position = 0;
+    }
+
+    return player->current != NULL;
+}
+
+
+
+/* Return a pointer to the next frames of the loop, at most 'max' of
+ * them.  The number of frames available is stored in 'count'. */
+unsigned char* loop_next(loop_player* player, int max, int* count)
+{
+    noise_loop* cur  = player->current;
+    noise_loop* prev = player->previous;
+    int C = player->channels;
+    unsigned char* out;
+    int i, c, n;
+    double t, sum;
+
+    if (prev != NULL)
+    {
+        n = MIN(max, LOOP_SWAP_FADE - player->fadePosition);
+        for (i=0; i<n; i++)
+        {
+            t = 0.5 * M_PI * ((double) (player->fadePosition + i) + 0.5) / LOOP_SWAP_FADE;
+            for (c=0; c<C; c++)
+            {
+                sum = 128.0 +
+                    ((double) cur->samples[player->position*C + c] - 128.0) * sin(t) +
+                    ((double) prev->samples[player->prevPosition*C + c] - 128.0) * cos(t);
+                if (sum > 255.0)
+                {
+                    sum = 255.0;
+                }
+                else if (sum < 0.0)
+                {
+                    sum = 0.0;
+                }
+                player->fadeBuf[i*C + c] = sum;
+            }
+
+            if (++player->position == cur->length)
+            {
+                player->position = 0;
+            }
+            if (++player->prevPosition == prev->length)
+            {
+                player->prevPosition = 0;
+            }
+        }
+
+        player->fadePosition += n;
+        if (player->fadePosition == LOOP_SWAP_FADE)
+        {
+            loop_retire(player, prev);
+            player->previous = NULL;
+        }
+
+        *count = n;
+        return player->fadeBuf;
+    }
+
+    n = MIN(max, cur->length - player->position);
+    out = cur->samples + player->position*C;
+    player->position += n;
+    if (player->position == cur->length)
+    {
+        player->position = 0;
+    }
+
+    *count = n;
+    return out;
+}
+
+
+/* arch-tag: seamless loop playback */
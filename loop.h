@@ -0,0 +1,98 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef LOOP_H
+#define LOOP_H 1
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "filter.h"
+#include "noise.h"
+
+/* Number of frames used to crossfade between an old loop and its
+ * replacement when the parameters change. */
+#define LOOP_SWAP_FADE 1024
+
+
+/* A block of pre-rendered noise which can be played back end-to-end
+ * without an audible seam. */
+typedef struct noise_loop
+{
+    unsigned char* samples;
+    long length;            /* in frames */
+
+    /* Set when the samples are mapped from the on-disk cache */
+    void* map;
+    size_t mapSize;
+
+    /* Next in the list of loops waiting to be freed */
+    struct noise_loop* next;
+} noise_loop;
+
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int running;
+    int seconds;
+    int channels;
+
+    /* With a fixed seed every render is the same noise, and the cache is
+     * bypassed since it may hold loops made from other noise */
+    int seeded;
+    uint64_t seed;
+
+    /* Render request, guarded by 'lock' */
+    int pending;
+    int generation;
+    uint64_t key;
+    double coeff[MAX_FILTER_LEN];
+    int filterLength;
+    int rate;
+
+    /* Finished loop waiting to be picked up, guarded by 'lock' */
+    noise_loop* ready;
+
+    /* Loops done with by the audio thread, for the renderer to free,
+     * guarded by 'lock' */
+    noise_loop* retired;
+
+    /* Playback state, owned by the audio thread */
+    noise_loop* current;
+    long position;
+    noise_loop* previous;
+    long prevPosition;
+    int fadePosition;
+    unsigned char fadeBuf[LOOP_SWAP_FADE * MAX_CHANNELS];
+} loop_player;
+
+
+int  loop_init( loop_player*, int, int, int, uint64_t );
+void loop_exit( loop_player* );
+void loop_request( loop_player*, double*, int, int );
+int  loop_update( loop_player* );
+unsigned char* loop_next( loop_player*, int, int* );
+
+
+#endif
+
+
+/* arch-tag: seamless loop playback (header) */
@@ -0,0 +1,207 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* multirate.c
+ * Most of the band that filter() computes is thrown away when the cutoff
+ * is low.  Here the noise is generated and filtered at 1/L of the output
+ * rate, with the cutoff scaled up by L and the filter shortened by L,
+ * which gives the same transition width in Hz.  A polyphase interpolator
+ * then brings it back to the output rate, computing each output sample
+ * from MULTIRATE_TAPS low-rate samples.
+ *
+ * The noise is scaled by 1/sqrt(L) before filtering, since its power is
+ * spread over L times less bandwidth; the result has the same spectral
+ * density, and the same loudness, as the direct path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "multirate.h"
+
+/* The low-rate cutoff is kept below this, leaving the interpolator a
+ * transition band as wide as the passband */
+#define MULTIRATE_LIMIT 0.5
+
+#define Q15_ONE (1 << Q15_SHIFT)
+
+
+
+/* Room needed in the arena by multirate_init() */
+size_t multirate_size(int channels, long frames)
+{
+    return ARENA_SPACE(2 * frames * channels) +
+           ARENA_SPACE((MULTIRATE_TAPS - 1 + frames) * channels) +
+           ARENA_SPACE(frames * channels);
+}
+
+
+
+/* Buffers are sized for blocks of 'frames' output frames, which must be
+ * a multiple of MULTIRATE_MAX_FACTOR, and taken from 'mem'.
+ * multirate_design() must be called before the first block is rendered. */
+int multirate_init(multirate_gen* mr, arena* mem, int channels, long frames)
+{
+    memset(mr, 0, sizeof(multirate_gen));
+    mr->channels = channels;
+    mr->frames   = frames;
+
+    if ((mr->data = (unsigned char *) arena_alloc(mem, 2 * frames * channels)) == NULL ||
+        (mr->low = (unsigned char *) arena_alloc(mem, (MULTIRATE_TAPS - 1 + frames) *
+                                                      channels)) == NULL ||
+        (mr->phased = (unsigned char *) arena_alloc(mem, frames * channels)) == NULL)
+    {
+        return -1;
+    }
+    memset(mr->low, 128, (MULTIRATE_TAPS - 1) * channels);
+    return 0;
+}
+
+
+
+/* Fill 'frames' frames of low-rate noise, at the reduced level */
+static void multirate_noise(multirate_gen* mr, noise_gen* noise, unsigned char* out, long frames)
+{
+    long i;
+
+    noise_fill(noise, out, frames);
+    if (mr->factor > 1)
+    {
+        for (i=0; i<frames * mr->channels; i++)
+        {
+            out[i] = 128 + ((((int32_t) out[i] - 128) * mr->gain) >> Q15_SHIFT);
+        }
+    }
+}
+
+
+
+/* Set up for a lowpass of type 'type', length 'M' and the given cutoff at
+ * the output rate.  The factor is the largest one that keeps the scaled
+ * cutoff within MULTIRATE_LIMIT; if that is 1, blocks are simply
+ * generated and filtered as usual. */
+void multirate_design(multirate_gen* mr, noise_gen* noise, int type, int M, double cutoff)
+{
+    double proto[MULTIRATE_MAX_FACTOR * MULTIRATE_TAPS];
+    int L, ph, j, peak;
+    int32_t sum;
+    double q;
+
+    L = 1;
+    while (2 * L <= MULTIRATE_MAX_FACTOR && cutoff * 2 * L <= MULTIRATE_LIMIT)
+    {
+        L *= 2;
+    }
+
+    mr->lowLength = (M + L - 1) / L;
+    computeFilterCoeff(type, mr->lowCoeff, mr->lowLength, cutoff * L);
+    mr->gain = (int32_t) (Q15_ONE / sqrt((double) L) + 0.5);
+
+    /* The interpolator is a Hamming-windowed lowpass at the low rate's
+     * Nyquist frequency, split into its L phases.  Each phase is scaled
+     * to unity gain at DC, exactly, so that the level doesn't ripple at
+     * the low rate. */
+    if (L > 1)
+    {
+        computeFilterCoeff(HAMMING, proto, L * MULTIRATE_TAPS, 1.0 / L);
+        for (ph=0; ph<L; ph++)
+        {
+            sum  = 0;
+            peak = 0;
+            for (j=0; j<MULTIRATE_TAPS; j++)
+            {
+                q = proto[ph + (MULTIRATE_TAPS - 1 - j) * L] * L * Q15_ONE;
+                mr->phase[ph][j] = (int16_t) floor(q + 0.5);
+                sum += mr->phase[ph][j];
+                if (abs(mr->phase[ph][j]) > abs(mr->phase[ph][peak]))
+                {
+                    peak = j;
+                }
+            }
+            mr->phase[ph][peak] += Q15_ONE - sum;
+        }
+        printf("Generating at 1/%d of the output rate, with a %d-tap filter.\n",
+               L, mr->lowLength);
+    }
+
+    /* The filter history is at the old rate; start it again */
+    if (L != mr->factor)
+    {
+        mr->factor = L;
+        multirate_noise(mr, noise, mr->data, mr->frames / L);
+    }
+}
+
+
+
+/* Interpolate the new low-rate samples into 'output'.  Each phase is
+ * convolved over the whole block at once, then the phases are woven
+ * together. */
+static void multirate_interpolate(multirate_gen* mr, unsigned char* output)
+{
+    int C = mr->channels;
+    int L = mr->factor;
+    long N = mr->frames / L;
+    long n;
+    int ph, c;
+    unsigned char* z;
+
+    for (ph=0; ph<L; ph++)
+    {
+        filter_fixed(mr->low, mr->phased + ph*N*C, N*C, C, mr->phase[ph], MULTIRATE_TAPS);
+    }
+
+    for (n=0; n<N; n++)
+    {
+        z = mr->phased + n*C;
+        for (ph=0; ph<L; ph++)
+        {
+            for (c=0; c<C; c++)
+            {
+                *output++ = z[ph*N*C + c];
+            }
+        }
+    }
+
+    /* Keep the newest samples as history */
+    memmove(mr->low, mr->low + N*C, (MULTIRATE_TAPS - 1) * C);
+}
+
+
+
+/* Render one block of mr->frames frames into 'output' */
+void multirate_render(multirate_gen* mr, noise_gen* noise, unsigned char* output)
+{
+    int C = mr->channels;
+    long N = mr->frames / mr->factor;
+
+    multirate_noise(mr, noise, mr->data + N*C, N);
+    if (mr->factor == 1)
+    {
+        filter(mr->data, output, N, C, mr->lowCoeff, mr->lowLength);
+        return;
+    }
+
+    filter(mr->data, mr->low + (MULTIRATE_TAPS - 1) * C, N, C, mr->lowCoeff, mr->lowLength);
+    multirate_interpolate(mr, output);
+}
+
+
+/* arch-tag: multirate generation */
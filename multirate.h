@@ -0,0 +1,63 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef MULTIRATE_H
+#define MULTIRATE_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+#include "filter.h"
+#include "noise.h"
+
+/* Largest interpolation factor; block sizes must be a multiple of it */
+#define MULTIRATE_MAX_FACTOR 8
+
+/* Taps per phase of the interpolator */
+#define MULTIRATE_TAPS 8
+
+
+/* Generates filtered noise at a fraction of the output rate, and
+ * interpolates it back up */
+typedef struct
+{
+    int channels;
+    long frames;            /* output frames per block */
+
+    int factor;             /* output rate / generation rate */
+    int lowLength;
+    double lowCoeff[MAX_FILTER_LEN];
+    int32_t gain;           /* Q15 scale applied to the noise */
+    int16_t phase[MULTIRATE_MAX_FACTOR][MULTIRATE_TAPS];
+
+    unsigned char* data;    /* noise at the low rate, history then new */
+    unsigned char* low;     /* filtered, MULTIRATE_TAPS-1 frames of history first */
+    unsigned char* phased;  /* interpolated output, one phase after another */
+} multirate_gen;
+
+
+size_t multirate_size( int, long );
+int  multirate_init( multirate_gen*, arena*, int, long );
+void multirate_design( multirate_gen*, noise_gen*, int, int, double );
+void multirate_render( multirate_gen*, noise_gen*, unsigned char* );
+
+
+#endif
+
+
+/* arch-tag: multirate generation (header) */
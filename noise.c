@@ -0,0 +1,136 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* noise.c
+ * Uniform 8-bit noise.  Each channel has its own 64-bit linear
+ * congruential generator, of which only the top byte is used.  The
+ * channels are stepped side by side, so the compiler can keep them in
+ * the lanes of a vector register.
+ */
+
+#include "noise.h"
+
+
+/* Scramble a seed, so that nearby seeds give unrelated lanes */
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+
+void noise_init(noise_gen* gen, uint64_t seed, int channels)
+{
+    int c;
+
+    gen->channels = channels;
+    for (c=0; c<MAX_CHANNELS; c++)
+    {
+        gen->lane[c] = splitmix64(seed + c);
+    }
+}
+
+
+
+/* Step 'C' lanes at once.  Inlined with constant 'C' for the common
+ * channel counts. */
+static inline void noise_lanes(uint64_t* lane, unsigned char* out, long frames, const int C)
+{
+    uint64_t s[MAX_CHANNELS];
+    long n;
+    int c;
+
+    for (c=0; c<C; c++)
+    {
+        s[c] = lane[c];
+    }
+    for (n=0; n<frames; n++)
+    {
+        for (c=0; c<C; c++)
+        {
+            s[c] = s[c] * LCG_MUL + LCG_INC;
+            out[n*C + c] = s[c] >> 56;
+        }
+    }
+    for (c=0; c<C; c++)
+    {
+        lane[c] = s[c];
+    }
+}
+
+
+
+/* Write 'frames' frames of interleaved noise to 'out' */
+void noise_fill(noise_gen* gen, unsigned char* out, long frames)
+{
+    switch (gen->channels)
+    {
+        case 1:
+            noise_lanes(gen->lane, out, frames, 1);
+            break;
+        case 2:
+            noise_lanes(gen->lane, out, frames, 2);
+            break;
+        case 4:
+            noise_lanes(gen->lane, out, frames, 4);
+            break;
+        case 8:
+            noise_lanes(gen->lane, out, frames, 8);
+            break;
+        default:
+            noise_lanes(gen->lane, out, frames, gen->channels);
+            break;
+    }
+}
+
+
+
+/* Advance every lane by 'frames' steps without producing any output.
+ * The composition of k steps is itself an affine map,
+ *   s -> A^k s + c (A^(k-1) + ... + A + 1),
+ * which is built up by squaring in O(log k) time. */
+void noise_skip(noise_gen* gen, uint64_t frames)
+{
+    uint64_t mul = LCG_MUL, inc = LCG_INC;
+    uint64_t accMul = 1, accInc = 0;
+    int c;
+
+    while (frames > 0)
+    {
+        if (frames & 1)
+        {
+            accMul *= mul;
+            accInc = accInc * mul + inc;
+        }
+        inc *= mul + 1;
+        mul *= mul;
+        frames >>= 1;
+    }
+
+    for (c=0; c<MAX_CHANNELS; c++)
+    {
+        gen->lane[c] = gen->lane[c] * accMul + accInc;
+    }
+}
+
+
+/* arch-tag: uniform noise source */
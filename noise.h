@@ -0,0 +1,45 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef NOISE_H
+#define NOISE_H 1
+
+#include <stdint.h>
+
+#define MAX_CHANNELS 8
+
+/* Each lane steps as  s = s * LCG_MUL + LCG_INC  and outputs s >> 56 */
+#define LCG_MUL 6364136223846793005ULL
+#define LCG_INC 1442695040888963407ULL
+
+/* One independent generator per channel */
+typedef struct
+{
+    uint64_t lane[MAX_CHANNELS];
+    int channels;
+} noise_gen;
+
+void noise_init( noise_gen*, uint64_t, int );
+void noise_fill( noise_gen*, unsigned char*, long );
+void noise_skip( noise_gen*, uint64_t );
+
+
+#endif
+
+
+/* arch-tag: uniform noise source (header) */
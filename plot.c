@@ -19,7 +19,8 @@
 
 /* plot.c
  * Functions associated with plotting filters in both time and frequency domains.
- */ 
+ * Plots are drawn in-process by a worker thread, as PNG and SVG images.
+ */
 
 
 #include "plot.h"
@@ -27,162 +28,649 @@
 #ifdef HAS_FFTW3
 #include <fftw3.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <errno.h>
+#include <stdio.h>
 #include <string.h>
-#include <limits.h>
-#include <unistd.h>
-#include <libgen.h>
+#include <stdint.h>
 #include "math.h"
+#include "userdir.h"
+#include "rt.h"
+#include "fft.h"
 
 
 #define MAX(X,Y) ((X) > (Y) ? (X) : (Y))
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 
-#define PLOT_RELPATH        "/.whitenoise/plot-data"
-#define COMMANDS_RELPATH    "/.whitenoise/plot-commands"
+#define PNG_NAME            "filter.png"
+#define SVG_NAME            "filter.svg"
 
+/* Gain below the peak at which the plot is cut off */
+#define PLOT_RANGE_DB       80.0
 
-char * path_join(char *buf, const char *home_path, const char *rel_path)
+/* Palette entries for the PNG image */
+#define COLOR_BACKGROUND    0
+#define COLOR_AXES          1
+#define COLOR_GRID          2
+#define COLOR_CURVE         3
+
+
+typedef struct
 {
-    strcpy(buf, home_path);
-    strcat(buf, rel_path);
-    return buf;
+    int width;
+    int height;
+    unsigned char* pixels;
+} raster;
+
+
+/* 3x5 glyphs for tick labels, one row per byte, most significant bit on
+ * the left. */
+static const char GLYPH_CHARS[] = "0123456789-.";
+static const unsigned char GLYPHS[][5] =
+{
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7},
+    {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1},
+    {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7}, {0, 0, 7, 0, 0}, {0, 0, 0, 0, 2}
+};
+
+
+
+/* ---------------------------------------------------------------------
+ * PNG encoding.  The image data is stored uncompressed, which keeps the
+ * encoder tiny; plots are mostly background and small anyway.
+ */
+
+static uint32_t crc_table[256];
+static int crc_table_ready = 0;
+
+static void crc_init(void)
+{
+    uint32_t c;
+    int n, k;
+
+    for (n=0; n<256; n++)
+    {
+        c = (uint32_t) n;
+        for (k=0; k<8; k++)
+        {
+            c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+    crc_table_ready = 1;
 }
 
 
-void plotFilter( double* coeff, int M, double* fft_in, fftw_complex* fft_out, 
-        fftw_plan p, int rate, int width )
+static uint32_t crc_update(uint32_t crc, const unsigned char* buf, size_t len)
 {
-    int i, err;
-    double a, b, f;
-    double fft_mag[FFT_SIZE];
-    FILE* gnuplot_data;
-    FILE* gnuplot_commands;
-    double scale;
-    const char* home_path;
-    char* file_path = NULL;
-    int file_path_chars = 0;
-    char cwd[PATH_MAX];
-    
-    if (getcwd(cwd, sizeof(cwd)) == NULL)
-    {
-        fprintf(stderr, "Could not get working directory.\n");
-        fprintf(stderr, "Aborting frequency response plot.\n");
-        return;
+    size_t i;
+
+    for (i=0; i<len; i++)
+    {
+        crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
     }
-    
-    /* gnuplot hangs on very small plots... */
-    if (width < 100)
+    return crc;
+}
+
+
+static void put_be32(unsigned char* buf, uint32_t val)
+{
+    buf[0] = val >> 24;
+    buf[1] = val >> 16;
+    buf[2] = val >> 8;
+    buf[3] = val;
+}
+
+
+static int png_chunk(FILE* f, const char* type, const unsigned char* data, size_t len)
+{
+    unsigned char buf[4];
+    uint32_t crc;
+
+    put_be32(buf, len);
+    crc = crc_update(0xffffffffUL, (const unsigned char *) type, 4);
+    crc = crc_update(crc, data, len);
+    if (fwrite(buf, 4, 1, f) != 1 || fwrite(type, 4, 1, f) != 1 ||
+        (len > 0 && fwrite(data, len, 1, f) != 1))
     {
-       width = 100;
+        return -1;
     }
-    /* ...and large plots consume require unreasonable memory */
-    else if (width > 3000)
+    put_be32(buf, crc ^ 0xffffffffUL);
+    return fwrite(buf, 4, 1, f) == 1 ? 0 : -1;
+}
+
+
+static int png_write(raster* r, const char* path)
+{
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    static const unsigned char palette[12] =
     {
-       width = 3000;
+        255, 255, 255,      /* background */
+        0,   0,   0,        /* axes */
+        208, 208, 208,      /* grid */
+        204, 0,   0         /* curve */
+    };
+    unsigned char header[13];
+    unsigned char* idat;
+    size_t raw_len, idat_len, pos, block, i;
+    uint32_t a = 1, b = 0;
+    int y, err;
+    FILE* f;
+
+    if (!crc_table_ready)
+    {
+        crc_init();
     }
-    scale = ((double) width) / 640.0;
 
-    /* the FFT input is a zero-padded version of the filter coefficients */
-    for (i=0; i<M; i++)
+    /* zlib stream of stored deflate blocks, one filter byte per row */
+    raw_len  = (size_t) r->height * (r->width + 1);
+    idat_len = 2 + raw_len + 5 * ((raw_len + 65534) / 65535) + 4;
+    if ((idat = (unsigned char *) malloc(idat_len)) == NULL)
     {
-        fft_in[i] = coeff[i];
+        return -1;
     }
-    for (i=M; i<FFT_SIZE; i++)
+    pos = 0;
+    idat[pos++] = 0x78;
+    idat[pos++] = 0x01;
+    block = 0;
+    for (y=0; y<r->height; y++)
     {
-        fft_in[i] = 0.0;
+        for (i=0; i<(size_t) r->width + 1; i++)
+        {
+            if (block == 0)
+            {
+                block = MIN(65535, raw_len);
+                raw_len -= block;
+                idat[pos++] = (raw_len == 0);
+                idat[pos++] = block & 0xff;
+                idat[pos++] = block >> 8;
+                idat[pos++] = ~block & 0xff;
+                idat[pos++] = (~block >> 8) & 0xff;
+            }
+            idat[pos] = (i == 0) ? 0 : r->pixels[y * r->width + i - 1];
+            a = (a + idat[pos]) % 65521;
+            b = (b + a) % 65521;
+            pos++;
+            block--;
+        }
     }
+    put_be32(idat + pos, (b << 16) | a);
+    pos += 4;
 
-    fftw_execute(p);
+    put_be32(header, r->width);
+    put_be32(header + 4, r->height);
+    header[8]  = 8;     /* bit depth */
+    header[9]  = 3;     /* indexed color */
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
 
-    /* get the FFT magnitude (dB) */
-    for (i=0; i<FFT_SIZE/2 + 1; i++)
+    if ((f = fopen(path, "wb")) == NULL)
     {
-        a = fft_out[i][0];
-        b = fft_out[i][1];
+        free(idat);
+        return -1;
+    }
+    err = (fwrite(signature, 8, 1, f) != 1) ||
+          png_chunk(f, "IHDR", header, 13) < 0 ||
+          png_chunk(f, "PLTE", palette, 12) < 0 ||
+          png_chunk(f, "IDAT", idat, pos) < 0 ||
+          png_chunk(f, "IEND", NULL, 0) < 0;
+    err = (fclose(f) != 0) || err;
 
-        fft_mag[i] = 10.0*log10(sqrt(a*a + b*b));
+    free(idat);
+    return err ? -1 : 0;
+}
+
+
+
+/* ---------------------------------------------------------------------
+ * Rasterization
+ */
+
+static void plot_pixel(raster* r, int x, int y, unsigned char color)
+{
+    if (x >= 0 && x < r->width && y >= 0 && y < r->height)
+    {
+        r->pixels[y * r->width + x] = color;
+    }
+}
+
+
+static void plot_line(raster* r, int x0, int y0, int x1, int y1, unsigned char color)
+{
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    int e2;
+
+    for (;;)
+    {
+        plot_pixel(r, x0, y0, color);
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+        e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+
+/* Draw 'text' with its top right corner at (x, y) */
+static void plot_text(raster* r, int x, int y, int scale, const char* text)
+{
+    int len = strlen(text);
+    int c, row, col, i, j;
+    const char* g;
+
+    x -= len * 4 * scale;
+    for (c=0; c<len; c++)
+    {
+        if ((g = strchr(GLYPH_CHARS, text[c])) == NULL)
+        {
+            continue;
+        }
+        for (row=0; row<5; row++)
+        {
+            for (col=0; col<3; col++)
+            {
+                if (GLYPHS[g - GLYPH_CHARS][row] & (4 >> col))
+                {
+                    for (i=0; i<scale; i++)
+                    {
+                        for (j=0; j<scale; j++)
+                        {
+                            plot_pixel(r, x + (c*4 + col)*scale + i,
+                                    y + row*scale + j, COLOR_AXES);
+                        }
+                    }
+                }
+            }
+        }
     }
+}
+
+
+/* Choose a round tick spacing giving roughly 'count' ticks over 'range' */
+static double tick_step(double range, int count)
+{
+    double raw = range / count;
+    double mag = pow(10.0, floor(log10(raw)));
+    double norm = raw / mag;
 
-    home_path = getenv("HOME");
-    if (home_path == NULL)
+    if (norm < 1.5)
     {
-        home_path = ".";
+        return mag;
     }
-    
-    file_path_chars = strlen(home_path) + MAX(strlen(PLOT_RELPATH), strlen(COMMANDS_RELPATH));
-    if ((file_path =
-            (char *) malloc((file_path_chars + 1) * sizeof(char))) == NULL)
+    else if (norm < 3.0)
+    {
+        return 2.0 * mag;
+    }
+    else if (norm < 7.0)
+    {
+        return 5.0 * mag;
+    }
+    return 10.0 * mag;
+}
+
+
+
+/* ---------------------------------------------------------------------
+ * Plot rendering
+ */
+
+typedef struct
+{
+    double fmax;
+    double ymin;
+    double ymax;
+    double xstep;
+    double ystep;
+} plot_axes;
+
+
+static void plot_axes_fit(plot_axes* axes, double* mag, int n, int rate)
+{
+    int i;
+    double peak = -1e300;
+
+    for (i=0; i<n; i++)
+    {
+        peak = MAX(peak, mag[i]);
+    }
+    axes->fmax  = rate / 2.0;
+    axes->ystep = 10.0;
+    axes->ymax  = ceil(peak / axes->ystep) * axes->ystep;
+    axes->ymin  = axes->ymax - PLOT_RANGE_DB;
+    axes->xstep = tick_step(axes->fmax, 6);
+}
+
+
+static int plot_png(double* mag, int n, plot_axes* axes, int width, const char* path)
+{
+    raster r;
+    int height = width * 3 / 4;
+    int scale = MAX(1, width / 320);
+    int left = 24 * scale, right = width - 8 * scale;
+    int top = 8 * scale, bottom = height - 12 * scale;
+    int i, x, y, px = 0, py = 0;
+    double v;
+    char label[32];
+    int err;
+
+    r.width  = width;
+    r.height = height;
+    if ((r.pixels = (unsigned char *) calloc(width, height)) == NULL)
+    {
+        return -1;
+    }
+
+    /* grid and tick labels */
+    for (v = 0.0; v <= axes->fmax + 1e-9; v += axes->xstep)
+    {
+        x = left + (int) ((right - left) * v / axes->fmax);
+        plot_line(&r, x, top, x, bottom, COLOR_GRID);
+        snprintf(label, sizeof(label), "%g", v);
+        plot_text(&r, x + strlen(label) * 2 * scale, bottom + 3 * scale, scale, label);
+    }
+    for (v = axes->ymin; v <= axes->ymax + 1e-9; v += axes->ystep)
+    {
+        y = bottom - (int) ((bottom - top) * (v - axes->ymin) / (axes->ymax - axes->ymin));
+        plot_line(&r, left, y, right, y, COLOR_GRID);
+        snprintf(label, sizeof(label), "%g", v);
+        plot_text(&r, left - 2 * scale, y - 2 * scale, scale, label);
+    }
+    plot_line(&r, left, top, right, top, COLOR_AXES);
+    plot_line(&r, left, bottom, right, bottom, COLOR_AXES);
+    plot_line(&r, left, top, left, bottom, COLOR_AXES);
+    plot_line(&r, right, top, right, bottom, COLOR_AXES);
+
+    /* the response itself */
+    for (i=0; i<n; i++)
+    {
+        v = MAX(mag[i], axes->ymin);
+        x = left + (int) ((double) (right - left) * i / (n - 1));
+        y = bottom - (int) ((bottom - top) * (v - axes->ymin) / (axes->ymax - axes->ymin));
+        if (i > 0)
+        {
+            plot_line(&r, px, py, x, y, COLOR_CURVE);
+        }
+        px = x;
+        py = y;
+    }
+
+    err = png_write(&r, path);
+    free(r.pixels);
+    return err;
+}
+
+
+static int plot_svg(double* mag, int n, plot_axes* axes, int width, const char* path)
+{
+    const double w = 640.0, h = 480.0;
+    const double left = 70.0, right = w - 20.0, top = 40.0, bottom = h - 50.0;
+    double v, x, y;
+    int i, err;
+    FILE* f;
+
+    if ((f = fopen(path, "w")) == NULL)
+    {
+        return -1;
+    }
+
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+            "viewBox=\"0 0 %g %g\" font-family=\"sans-serif\" font-size=\"12\">\n",
+            width, width * 3 / 4, w, h);
+    fprintf(f, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+    fprintf(f, "<text x=\"%g\" y=\"24\" text-anchor=\"middle\" font-size=\"14\">"
+            "Frequency response of lowpass filter</text>\n", (left + right) / 2);
+    fprintf(f, "<text x=\"%g\" y=\"%g\" text-anchor=\"middle\">frequency (Hz)</text>\n",
+            (left + right) / 2, h - 10);
+    fprintf(f, "<text x=\"16\" y=\"%g\" text-anchor=\"middle\" "
+            "transform=\"rotate(-90 16 %g)\">gain (dB)</text>\n",
+            (top + bottom) / 2, (top + bottom) / 2);
+
+    fprintf(f, "<g stroke=\"#d0d0d0\">\n");
+    for (v = 0.0; v <= axes->fmax + 1e-9; v += axes->xstep)
+    {
+        x = left + (right - left) * v / axes->fmax;
+        fprintf(f, "<line x1=\"%.1f\" y1=\"%g\" x2=\"%.1f\" y2=\"%g\"/>\n", x, top, x, bottom);
+    }
+    for (v = axes->ymin; v <= axes->ymax + 1e-9; v += axes->ystep)
+    {
+        y = bottom - (bottom - top) * (v - axes->ymin) / (axes->ymax - axes->ymin);
+        fprintf(f, "<line x1=\"%g\" y1=\"%.1f\" x2=\"%g\" y2=\"%.1f\"/>\n", left, y, right, y);
+    }
+    fprintf(f, "</g>\n<g text-anchor=\"middle\">\n");
+    for (v = 0.0; v <= axes->fmax + 1e-9; v += axes->xstep)
+    {
+        x = left + (right - left) * v / axes->fmax;
+        fprintf(f, "<text x=\"%.1f\" y=\"%g\">%g</text>\n", x, bottom + 16, v);
+    }
+    fprintf(f, "</g>\n<g text-anchor=\"end\">\n");
+    for (v = axes->ymin; v <= axes->ymax + 1e-9; v += axes->ystep)
+    {
+        y = bottom - (bottom - top) * (v - axes->ymin) / (axes->ymax - axes->ymin);
+        fprintf(f, "<text x=\"%g\" y=\"%.1f\">%g</text>\n", left - 6, y + 4, v);
+    }
+    fprintf(f, "</g>\n<rect x=\"%g\" y=\"%g\" width=\"%g\" height=\"%g\" "
+            "fill=\"none\" stroke=\"black\"/>\n", left, top, right - left, bottom - top);
+
+    fprintf(f, "<polyline fill=\"none\" stroke=\"#cc0000\" points=\"");
+    for (i=0; i<n; i++)
+    {
+        v = MAX(mag[i], axes->ymin);
+        x = left + (right - left) * i / (n - 1);
+        y = bottom - (bottom - top) * (v - axes->ymin) / (axes->ymax - axes->ymin);
+        fprintf(f, "%.1f,%.1f ", x, y);
+    }
+    fprintf(f, "\"/>\n</svg>\n");
+
+    err = ferror(f);
+    err = (fclose(f) != 0) || err;
+    return err ? -1 : 0;
+}
+
+
+/* Write an image via a temporary file, so that viewers never see it
+ * half-written. */
+static void plot_save(double* mag, int n, plot_axes* axes, int width, const char* name,
+        int (*render)(double*, int, plot_axes*, int, const char*))
+{
+    char* path;
+    char* tmp_path = NULL;
+
+    if ((path = userdir_path(name)) == NULL ||
+        (tmp_path = (char *) malloc(strlen(path) + 5)) == NULL)
     {
         fprintf(stderr, "Out of memory.  Aborting frequency response plot.\n");
-        goto cleanup;
+        free(path);
+        return;
     }
-    
-    if (mkdir(dirname(path_join(file_path, home_path, PLOT_RELPATH)), 0744) < 0)
+    sprintf(tmp_path, "%s.tmp", path);
+
+    if (render(mag, n, axes, width, tmp_path) < 0 || rename(tmp_path, path) < 0)
+    {
+        fprintf(stderr, "Could not write \"~/.whitenoise/%s\".\n", name);
+        remove(tmp_path);
+    }
+
+    free(path);
+    free(tmp_path);
+}
+
+
+static void plot_render(plotter* plot, double* coeff, int M, int rate, int width)
+{
+    int i;
+    double a, b;
+    double fft_mag[FFT_SIZE/2 + 1];
+    plot_axes axes;
+
+    if (plot->plan == NULL)
     {
-        if (errno != EEXIST)
+        if ((plot->fft_in == NULL &&
+             (plot->fft_in = (double *) fftw_malloc(FFT_SIZE * sizeof(double))) == NULL) ||
+            (plot->fft_out == NULL &&
+             (plot->fft_out = (fftw_complex *) fftw_malloc((FFT_SIZE/2 + 1) * sizeof(fftw_complex))) == NULL))
         {
-            fprintf(stderr, "Could not create \"~/.whitenoise\".\n");
-            fprintf(stderr, "Aborting frequency response plot.\n");
-            goto cleanup;
+            fprintf(stderr, "Error: could not allocate FFT memory.\n");
+            return;
+        }
+        if ((plot->plan = fft_plan_r2c(FFT_SIZE, plot->fft_in, plot->fft_out)) == NULL)
+        {
+            fprintf(stderr, "Error: could not create FFT plan.\n");
+            return;
         }
     }
 
-    if ((gnuplot_data = fopen(path_join(file_path, home_path, PLOT_RELPATH), "w")) == NULL)
+    /* the FFT input is a zero-padded version of the filter coefficients */
+    for (i=0; i<M; i++)
     {
-        fprintf(stderr, "Could not open \"~/%s\" for writing.\n", PLOT_RELPATH);
-        fprintf(stderr, "Aborting frequency response plot.\n");
-        goto cleanup;
+        plot->fft_in[i] = coeff[i];
+    }
+    for (i=M; i<FFT_SIZE; i++)
+    {
+        plot->fft_in[i] = 0.0;
     }
 
+    fftw_execute(plot->plan);
+
+    /* get the FFT magnitude (dB) */
     for (i=0; i<FFT_SIZE/2 + 1; i++)
     {
-        f = ((double) rate * (double) i) / ((double) (FFT_SIZE/2 + 1)) / 2.0;
-        /* a -inf value will cause gnuplot to hang */
-        if (fft_mag[i] > -1e200)
+        a = plot->fft_out[i][0];
+        b = plot->fft_out[i][1];
+
+        fft_mag[i] = 10.0*log10(sqrt(a*a + b*b));
+    }
+
+    plot_axes_fit(&axes, fft_mag, FFT_SIZE/2 + 1, rate);
+    plot_save(fft_mag, FFT_SIZE/2 + 1, &axes, width, PNG_NAME, plot_png);
+    plot_save(fft_mag, FFT_SIZE/2 + 1, &axes, width, SVG_NAME, plot_svg);
+}
+
+
+static void* plot_worker(void* arg)
+{
+    plotter* plot = (plotter *) arg;
+    double coeff[MAX_FILTER_LEN];
+    int M, rate, width;
+
+    rt_demote();
+
+    pthread_mutex_lock(&plot->lock);
+    while (plot->running)
+    {
+        if (!plot->pending)
+        {
+            pthread_cond_wait(&plot->wake, &plot->lock);
+            continue;
+        }
+        M     = plot->M;
+        rate  = plot->rate;
+        width = plot->width;
+        memcpy(coeff, plot->coeff, M * sizeof(double));
+        plot->pending = 0;
+        pthread_mutex_unlock(&plot->lock);
+
+        /* Nothing to do if the last plot shows the same thing */
+        if (M != plot->lastM || rate != plot->lastRate || width != plot->lastWidth ||
+            memcmp(coeff, plot->lastCoeff, M * sizeof(double)) != 0)
         {
-            fprintf(gnuplot_data, "%g     %g\n", f, fft_mag[i]);
+            plot_render(plot, coeff, M, rate, width);
+            memcpy(plot->lastCoeff, coeff, M * sizeof(double));
+            plot->lastM     = M;
+            plot->lastRate  = rate;
+            plot->lastWidth = width;
         }
+
+        pthread_mutex_lock(&plot->lock);
     }
-    fclose(gnuplot_data);
+    pthread_mutex_unlock(&plot->lock);
+
+    return NULL;
+}
 
-    if ((gnuplot_commands = fopen(path_join(file_path, home_path, COMMANDS_RELPATH), "w")) == NULL)
+
+
+/* Prepare the plotter.  The thread and FFT are not set up until the
+ * first plot is requested. */
+void plot_init(plotter* plot)
+{
+    memset(plot, 0, sizeof(plotter));
+    pthread_mutex_init(&plot->lock, NULL);
+    pthread_cond_init(&plot->wake, NULL);
+}
+
+
+
+/* Stop the plotting thread, after it finishes any plot in progress */
+void plot_exit(plotter* plot)
+{
+    if (plot->started)
     {
-        fprintf(stderr, "Could not open \"~%s\" for writing.\n", COMMANDS_RELPATH);
-        fprintf(stderr, "Aborting frequency response plot.\n");
-        goto cleanup;
+        pthread_mutex_lock(&plot->lock);
+        plot->running = 0;
+        pthread_cond_signal(&plot->wake);
+        pthread_mutex_unlock(&plot->lock);
+
+        pthread_join(plot->thread, NULL);
     }
-    fprintf(gnuplot_commands, "set terminal png small\n");
-    fprintf(gnuplot_commands, "set size %g,%g\n", scale, scale);
-    fprintf(gnuplot_commands, "set output \"filter.png\"\n");
-    fprintf(gnuplot_commands, "set title \"Frequency response of lowpass filter\"\n");
-    fprintf(gnuplot_commands, "set xlabel \"frequency (Hz)\"\n");
-    fprintf(gnuplot_commands, "set ylabel \"gain (dB)\"\n");
-    fprintf(gnuplot_commands, "set nokey\n");
-    fprintf(gnuplot_commands, "plot \"plot-data\" with lines\n");
-    fclose(gnuplot_commands);
-    
-    if (chdir(dirname(path_join(file_path, home_path, COMMANDS_RELPATH))) < 0)
+    pthread_mutex_destroy(&plot->lock);
+    pthread_cond_destroy(&plot->wake);
+
+    if (plot->plan != NULL) fft_destroy_plan(plot->plan);
+    if (plot->fft_in != NULL) fftw_free(plot->fft_in);
+    if (plot->fft_out != NULL) fftw_free(plot->fft_out);
+}
+
+
+
+/* Queue a plot of the filter's frequency response.  'width' is the
+ * horizontal resolution of the image.  Returns immediately; if a plot is
+ * already queued, it is replaced by this one. */
+void plotFilter(plotter* plot, double* coeff, int M, int rate, int width)
+{
+    /* keep the image size within reason */
+    if (width < 100)
     {
-        fprintf(stderr, "Could not set working directory.\n");
-        fprintf(stderr, "Aborting frequency response plot.\n");
-        goto cleanup;
+       width = 100;
     }
-    
-    if ((err = system("gnuplot < plot-commands")) == -1)
+    else if (width > 3000)
     {
-        fprintf(stderr, "Error: failed to launch gnuplot.\n");
-        fprintf(stderr, "You must have gnuplot installed in order to generate frequency response plots.\n");
+       width = 3000;
     }
 
-    /* Restore working directory */
-    if (chdir(cwd) == -1)
+    if (!plot->started)
     {
-        fprintf(stderr, "Error: could not restore working directory.\n");
+        plot->running = 1;
+        if (pthread_create(&plot->thread, NULL, plot_worker, plot) != 0)
+        {
+            fprintf(stderr, "Error: could not start plotting thread.\n");
+            return;
+        }
+        plot->started = 1;
     }
 
-cleanup:
-    free(file_path);
+    pthread_mutex_lock(&plot->lock);
+    memcpy(plot->coeff, coeff, M * sizeof(double));
+    plot->M       = M;
+    plot->rate    = rate;
+    plot->width   = width;
+    plot->pending = 1;
+    pthread_cond_signal(&plot->wake);
+    pthread_mutex_unlock(&plot->lock);
 }
 
 #endif /* HAS_FFTW3 */
@@ -16,6 +16,8 @@
     Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#ifndef PLOT_H
+#define PLOT_H 1
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -25,8 +27,42 @@
 
 #ifdef HAS_FFTW3
 #include <fftw3.h>
-void plotFilter( double* coeff, int M, double* fft_in, fftw_complex* fft_out, 
-      fftw_plan p, int rate, int width );
+#include <pthread.h>
+#include "filter.h"
+
+/* Renders frequency response plots in a background thread, so that the
+ * audio loop only has to copy the coefficients. */
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started;
+    int running;
+
+    /* Plot request, guarded by 'lock' */
+    int pending;
+    double coeff[MAX_FILTER_LEN];
+    int M;
+    int rate;
+    int width;
+
+    /* Owned by the worker, and set up on its first plot */
+    double* fft_in;
+    fftw_complex* fft_out;
+    fftw_plan plan;
+    double lastCoeff[MAX_FILTER_LEN];
+    int lastM;
+    int lastRate;
+    int lastWidth;
+} plotter;
+
+void plot_init( plotter* );
+void plot_exit( plotter* );
+void plotFilter( plotter*, double*, int, int, int );
+#endif
+
+
 #endif
 
 
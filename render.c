@@ -0,0 +1,238 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* render.c
+ * Renders long stretches of filtered noise ahead of time, on all cores.
+ *
+ * Output frame t is the filter applied to noise frames t .. t+M-1, no
+ * matter how the work is divided into blocks.  So the timeline can be cut
+ * into chunks which are rendered independently: each chunk jumps its own
+ * copy of the generator ahead to its first frame, and fills one block of
+ * history before its first output, which covers the M-1 frames of
+ * warm-up the filter needs.  The result is identical, byte for byte, to
+ * rendering the whole stretch in one thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "render.h"
+#include "filter.h"
+#include "rt.h"
+
+#define RENDER_MAX_THREADS 64
+
+
+typedef struct
+{
+    noise_gen start;        /* generator at the first frame */
+    unsigned char* out;
+    long frames;
+    double* coeff;
+    int M;
+    render_cancel cancel;
+    void* arg;
+
+    /* Guarded by 'lock' */
+    pthread_mutex_t lock;
+    long next;              /* first frame of the next chunk to render */
+    int failed;
+} render_job;
+
+
+
+/* Number of threads worth using */
+int render_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+    {
+        return 1;
+    }
+    return n > RENDER_MAX_THREADS ? RENDER_MAX_THREADS : (int) n;
+}
+
+
+
+static int render_failed(render_job* job)
+{
+    int failed;
+
+    pthread_mutex_lock(&job->lock);
+    if (!job->failed && job->cancel != NULL && job->cancel(job->arg))
+    {
+        job->failed = 1;
+    }
+    failed = job->failed;
+    pthread_mutex_unlock(&job->lock);
+
+    return failed;
+}
+
+
+
+/* Render frames [first, last) */
+static int render_chunk(render_job* job, long first, long last,
+        unsigned char* data, unsigned char* tail)
+{
+    int C = job->start.channels;
+    noise_gen noise = job->start;
+    long pos, n;
+
+    noise_skip(&noise, first);
+    noise_fill(&noise, data, RENDER_BLOCK);
+
+    for (pos=first; pos<last; pos+=n)
+    {
+        if (render_failed(job))
+        {
+            return -1;
+        }
+        n = last - pos < RENDER_BLOCK ? last - pos : RENDER_BLOCK;
+        noise_fill(&noise, data + RENDER_BLOCK*C, RENDER_BLOCK);
+        if (n == RENDER_BLOCK)
+        {
+            filter(data, job->out + pos*C, RENDER_BLOCK, C, job->coeff, job->M);
+        }
+        else
+        {
+            /* A short final block still needs the full history layout */
+            filter(data, tail, RENDER_BLOCK, C, job->coeff, job->M);
+            memcpy(job->out + pos*C, tail, n*C);
+        }
+    }
+    return 0;
+}
+
+
+
+static void* render_worker(void* arg)
+{
+    render_job* job = (render_job *) arg;
+    int C = job->start.channels;
+    unsigned char* data;
+    unsigned char* tail;
+    long first;
+
+    data = (unsigned char *) malloc(RENDER_BLOCK * 2 * C);
+    tail = (unsigned char *) malloc(RENDER_BLOCK * C);
+    if (data == NULL || tail == NULL)
+    {
+        pthread_mutex_lock(&job->lock);
+        job->failed = 1;
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    while (data != NULL && tail != NULL)
+    {
+        pthread_mutex_lock(&job->lock);
+        first = job->next;
+        job->next += RENDER_CHUNK;
+        pthread_mutex_unlock(&job->lock);
+
+        if (first >= job->frames ||
+            render_chunk(job, first, first + RENDER_CHUNK < job->frames ?
+                         first + RENDER_CHUNK : job->frames, data, tail) < 0)
+        {
+            break;
+        }
+    }
+
+    free(data);
+    free(tail);
+    return NULL;
+}
+
+
+
+/* Helper threads run at normal priority, like the other background work */
+static void* render_thread(void* arg)
+{
+    rt_demote();
+    return render_worker(arg);
+}
+
+
+
+/* Render 'frames' frames of noise from 'noise', filtered with the 'M'
+ * coefficients 'coeff', into 'out', using up to 'threads' threads (or one
+ * per core, if 'threads' is 0).  'cancel', if not NULL, is polled with
+ * 'arg' between blocks.  On success 'noise' is advanced by 'frames', so
+ * that consecutive calls render a continuous stream.  Returns -1 if the
+ * render failed or was cancelled. */
+int render_noise(noise_gen* noise, unsigned char* out, long frames,
+        double* coeff, int M, int threads, render_cancel cancel, void* arg)
+{
+    pthread_t tid[RENDER_MAX_THREADS];
+    render_job job;
+    int i, started;
+
+    job.start  = *noise;
+    job.out    = out;
+    job.frames = frames;
+    job.coeff  = coeff;
+    job.M      = M;
+    job.cancel = cancel;
+    job.arg    = arg;
+    job.next   = 0;
+    job.failed = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (threads <= 0)
+    {
+        threads = render_threads();
+    }
+    if (threads > RENDER_MAX_THREADS)
+    {
+        threads = RENDER_MAX_THREADS;
+    }
+    if (threads > (frames + RENDER_CHUNK - 1) / RENDER_CHUNK)
+    {
+        threads = (frames + RENDER_CHUNK - 1) / RENDER_CHUNK;
+    }
+
+    /* The calling thread takes a share too */
+    started = 0;
+    for (i=1; i<threads; i++)
+    {
+        if (pthread_create(&tid[started], NULL, render_thread, &job) == 0)
+        {
+            started++;
+        }
+    }
+    render_worker(&job);
+    for (i=0; i<started; i++)
+    {
+        pthread_join(tid[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed)
+    {
+        return -1;
+    }
+    noise_skip(noise, frames);
+    return 0;
+}
+
+
+/* arch-tag: parallel offline rendering */
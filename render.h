@@ -0,0 +1,41 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef RENDER_H
+#define RENDER_H 1
+
+#include "noise.h"
+
+/* Frames filtered at a time within a chunk */
+#define RENDER_BLOCK 1024
+
+/* Frames in each chunk handed to a thread */
+#define RENDER_CHUNK (64 * RENDER_BLOCK)
+
+/* Polled between blocks; a nonzero result abandons the render */
+typedef int (*render_cancel)( void* );
+
+int render_threads( void );
+int render_noise( noise_gen*, unsigned char*, long, double*, int, int,
+                  render_cancel, void* );
+
+
+#endif
+
+
+/* arch-tag: parallel offline rendering (header) */
@@ -0,0 +1,110 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* ring.c
+ * A single-producer, single-consumer ring buffer.  Neither side ever
+ * waits for the other: writes which do not fit are cut short, and reads
+ * return only what is available.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+
+#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
+
+
+int ring_init(ring* r, size_t size)
+{
+    if ((size & (size - 1)) != 0 ||
+        (r->buf = (unsigned char *) malloc(size)) == NULL)
+    {
+        return -1;
+    }
+    r->size = size;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return 0;
+}
+
+
+
+void ring_exit(ring* r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+
+
+/* Bytes which the producer may write */
+size_t ring_space(ring* r)
+{
+    return r->size - (atomic_load_explicit(&r->head, memory_order_relaxed) -
+                      atomic_load_explicit(&r->tail, memory_order_acquire));
+}
+
+
+
+/* Bytes which the consumer may read */
+size_t ring_fill(ring* r)
+{
+    return atomic_load_explicit(&r->head, memory_order_acquire) -
+           atomic_load_explicit(&r->tail, memory_order_relaxed);
+}
+
+
+
+/* Producer side.  Returns the number of bytes actually written. */
+size_t ring_write(ring* r, const unsigned char* data, size_t n)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t pos, first;
+
+    n = MIN(n, ring_space(r));
+    pos = head & (r->size - 1);
+    first = MIN(n, r->size - pos);
+    memcpy(r->buf + pos, data, first);
+    memcpy(r->buf, data + first, n - first);
+
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
+
+
+
+/* Consumer side.  Returns the number of bytes actually read. */
+size_t ring_read(ring* r, unsigned char* data, size_t n)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t pos, first;
+
+    n = MIN(n, ring_fill(r));
+    pos = tail & (r->size - 1);
+    first = MIN(n, r->size - pos);
+    memcpy(data, r->buf + pos, first);
+    memcpy(data + first, r->buf, n - first);
+
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+
+/* arch-tag: lock-free ring buffer */
@@ -0,0 +1,46 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef RING_H
+#define RING_H 1
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* Lock-free byte ring for exactly one producer and one consumer.  The
+ * size must be a power of two. */
+typedef struct
+{
+    unsigned char* buf;
+    size_t size;
+    atomic_size_t head;     /* written by the producer only */
+    atomic_size_t tail;     /* written by the consumer only */
+} ring;
+
+int    ring_init( ring*, size_t );
+void   ring_exit( ring* );
+size_t ring_space( ring* );
+size_t ring_fill( ring* );
+size_t ring_write( ring*, const unsigned char*, size_t );
+size_t ring_read( ring*, unsigned char*, size_t );
+
+
+#endif
+
+
+/* arch-tag: lock-free ring buffer (header) */
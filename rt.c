@@ -0,0 +1,291 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* rt.c
+ * Gives the audio thread realtime priority, locks memory and pins the
+ * thread to chosen CPUs, or for the opposite purpose lets its timers
+ * slip.  Each step is optional and falls back quietly to whatever the
+ * system allows; what was actually obtained is reported.  Also measures
+ * the CPU time and wakeups that playing costs.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include "rt.h"
+
+
+/* Affinity before pinning, which helper threads go back to */
+static cpu_set_t original_cpus;
+static int cpus_saved = 0;
+
+
+/* Parse a list such as "0-3,6" */
+static int rt_parse_cpus(const char* list, cpu_set_t* set)
+{
+    const char* p = list;
+    char* end;
+    long first, last, cpu;
+
+    CPU_ZERO(set);
+    while (*p != '\0')
+    {
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+        {
+            return -1;
+        }
+        last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+            {
+                return -1;
+            }
+            p = end;
+        }
+        for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, set);
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p != '\0')
+        {
+            return -1;
+        }
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+
+static void rt_schedule(rt_options* opts)
+{
+    struct sched_param param;
+    struct rlimit limit;
+    int policy = opts->roundRobin ? SCHED_RR : SCHED_FIFO;
+    const char* name = opts->roundRobin ? "SCHED_RR" : "SCHED_FIFO";
+    int prio = opts->priority;
+    int err;
+
+    if (prio < sched_get_priority_min(policy))
+    {
+        prio = sched_get_priority_min(policy);
+    }
+    else if (prio > sched_get_priority_max(policy))
+    {
+        prio = sched_get_priority_max(policy);
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = prio;
+    err = pthread_setschedparam(pthread_self(), policy, &param);
+
+    /* An unprivileged user may still be allowed a lower priority */
+    if (err == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0 &&
+        limit.rlim_cur > 0 && (int) limit.rlim_cur < prio)
+    {
+        param.sched_priority = limit.rlim_cur;
+        err = pthread_setschedparam(pthread_self(), policy, &param);
+    }
+
+    if (err == 0)
+    {
+        fprintf(stderr, "Realtime: %s, priority %d.\n", name, param.sched_priority);
+    }
+    else
+    {
+        fprintf(stderr, "Realtime: could not set %s (%s); using normal scheduling.\n",
+                name, strerror(err));
+    }
+}
+
+
+static void rt_lock_memory(void)
+{
+    volatile char stack[RT_PREFAULT_STACK];
+    char* heap;
+    int i;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        fprintf(stderr, "Realtime: could not lock memory (%s).\n", strerror(errno));
+        return;
+    }
+
+    /* Keep freed memory in the heap, where it stays locked, and fault in
+     * some headroom for both stack and heap. */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    for (i=0; i<RT_PREFAULT_STACK; i += 1024)
+    {
+        stack[i] = 0;
+    }
+    (void) stack[0];
+    if ((heap = (char *) malloc(RT_PREFAULT_HEAP)) != NULL)
+    {
+        memset(heap, 0, RT_PREFAULT_HEAP);
+        free(heap);
+    }
+
+    fprintf(stderr, "Realtime: memory locked, %d kB of stack and %d kB of heap prefaulted.\n",
+            RT_PREFAULT_STACK / 1024, RT_PREFAULT_HEAP / 1024);
+}
+
+
+static void rt_pin(const char* list)
+{
+    cpu_set_t set;
+    int err;
+
+    if (rt_parse_cpus(list, &set) < 0)
+    {
+        fprintf(stderr, "Realtime: could not parse CPU list \"%s\".\n", list);
+        return;
+    }
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(original_cpus), &original_cpus) == 0)
+    {
+        cpus_saved = 1;
+    }
+    if ((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+    {
+        fprintf(stderr, "Realtime: could not pin to CPUs %s (%s).\n", list, strerror(err));
+        return;
+    }
+    fprintf(stderr, "Realtime: pinned to CPUs %s.\n", list);
+}
+
+
+
+/* Let the kernel fire this thread's timers up to 'ns' late, so that its
+ * wakeups can be folded into others.  Threads created later inherit it;
+ * realtime threads ignore it. */
+static void rt_slack(long ns)
+{
+    if (prctl(PR_SET_TIMERSLACK, (unsigned long) ns, 0, 0, 0) < 0)
+    {
+        fprintf(stderr, "Power: could not set the timer slack (%s).\n", strerror(errno));
+        return;
+    }
+    fprintf(stderr, "Power: timers may slip by up to %ld ms.\n", ns / 1000000);
+}
+
+
+
+/* Apply the requested options to the calling thread, which should be the
+ * one rendering and writing audio. */
+void rt_setup(rt_options* opts)
+{
+    if (opts->lockMemory)
+    {
+        rt_lock_memory();
+    }
+    if (opts->cpus != NULL)
+    {
+        rt_pin(opts->cpus);
+    }
+    if (opts->priority > 0)
+    {
+        rt_schedule(opts);
+    }
+    if (opts->timerSlack > 0)
+    {
+        rt_slack(opts->timerSlack);
+    }
+}
+
+
+
+/* Threads inherit the scheduling of their creator.  Helper threads call
+ * this so that they never compete with the audio thread. */
+void rt_demote(void)
+{
+    struct sched_param param;
+    int policy;
+
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+        policy != SCHED_OTHER)
+    {
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+    if (cpus_saved)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(original_cpus), &original_cpus);
+    }
+}
+
+
+
+/* Note the resources used so far by the process, and by the calling
+ * thread, which should be the audio thread */
+void rt_usage_mark(rt_usage* u)
+{
+    clock_gettime(CLOCK_MONOTONIC, &u->wall);
+    getrusage(RUSAGE_SELF, &u->process);
+    getrusage(RUSAGE_THREAD, &u->thread);
+}
+
+
+
+static double rt_seconds(const struct timeval* tv)
+{
+    return (double) tv->tv_sec + (double) tv->tv_usec * 1e-6;
+}
+
+
+
+/* Report what has been used since 'u' was marked, during which 'audio'
+ * seconds of audio were written: CPU time across all threads, scaled to
+ * an hour of audio, and how often the audio thread went to sleep and
+ * was woken. */
+void rt_usage_report(rt_usage* u, double audio)
+{
+    rt_usage now;
+    double cpu, wall;
+
+    rt_usage_mark(&now);
+    cpu = rt_seconds(&now.process.ru_utime) - rt_seconds(&u->process.ru_utime) +
+          rt_seconds(&now.process.ru_stime) - rt_seconds(&u->process.ru_stime);
+    wall = (double) (now.wall.tv_sec - u->wall.tv_sec) +
+           (double) (now.wall.tv_nsec - u->wall.tv_nsec) * 1e-9;
+    if (audio <= 0.0 || wall <= 0.0)
+    {
+        return;
+    }
+    printf("Used %.1f s of CPU per hour of audio, waking %.1f times a second.\n",
+           cpu / audio * 3600.0,
+           (now.thread.ru_nvcsw - u->thread.ru_nvcsw) / wall);
+}
+
+
+/* arch-tag: realtime scheduling */
@@ -0,0 +1,56 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef RT_H
+#define RT_H 1
+
+#include <time.h>
+#include <sys/resource.h>
+
+/* Amount of stack and heap touched up front, so that the audio path
+ * does not take page faults later */
+#define RT_PREFAULT_STACK  (256 * 1024)
+#define RT_PREFAULT_HEAP   (4 * 1024 * 1024)
+
+typedef struct
+{
+    int priority;       /* realtime priority, or 0 for none */
+    int roundRobin;     /* use SCHED_RR rather than SCHED_FIFO */
+    int lockMemory;
+    const char* cpus;   /* CPU list such as "2,3" or "0-3", or NULL */
+    long timerSlack;    /* ns the kernel may defer timers by, or 0 */
+} rt_options;
+
+/* Resources used up to some moment, to compare with later */
+typedef struct
+{
+    struct timespec wall;
+    struct rusage process;
+    struct rusage thread;
+} rt_usage;
+
+void rt_setup( rt_options* );
+void rt_demote( void );
+void rt_usage_mark( rt_usage* );
+void rt_usage_report( rt_usage*, double );
+
+
+#endif
+
+
+/* arch-tag: realtime scheduling (header) */
@@ -0,0 +1,470 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* selftest.c
+ * Checks every filter kernel and the noise source against plain
+ * reference implementations, over a range of filter types, tap counts,
+ * block sizes and channel counts.  The whole seeded signal path is also
+ * checked against checksums recorded when it was known to be good, so
+ * that any change to what is actually played gets noticed, and the
+ * adaptive filter's crossfade is checked to be seamless.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "selftest.h"
+#include "adapt.h"
+#include "arena.h"
+#include "filter.h"
+#include "fused.h"
+#include "noise.h"
+
+
+#define SELFTEST_SEED     12345
+#define SELFTEST_MAX_N    1024
+#define GOLDEN_BLOCKS     8
+#define GOLDEN_BLOCK_SIZE 1024
+#define GOLDEN_LEN        25
+#define GOLDEN_CUTOFF     0.3
+#define ADAPT_TEST_RATE   22050
+#define ADAPT_TEST_BLOCKS 24
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+
+static const int  test_taps[]     = { 1, 2, 3, 7, 16, 25, 64, 100 };
+static const long test_blocks[]   = { 7, 100, 257, 1024 };
+static const int  test_channels[] = { 1, 2, 3, 4, 8 };
+static const long adapt_frames[]  = { 32, 256, 1024 };
+
+#define COUNT(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+
+/* Checksums of GOLDEN_BLOCKS blocks from the seeded signal path, for
+ * each kernel and filter type, in mono and in stereo.  If an intended
+ * change alters the output, the new values are printed by the failing
+ * test.  They are kept here rather than in a data file so that an
+ * installed whitenoise can check itself anywhere. */
+static const struct
+{
+    const char* kernel;
+    uint64_t sums[5][2];
+} golden[] =
+{
+    { "double",
+      { { 0x00535b3d5a29fffcULL, 0x2361530121bf12c0ULL },   /* Blackman */
+        { 0x259c43c2144d5c56ULL, 0x58c5d7aa983c67b5ULL },   /* Bartlett */
+        { 0x6b533ab805fd7d06ULL, 0x7cce45f44623b355ULL },   /* Hanning */
+        { 0xc536792de22bb123ULL, 0xc58d97e512a45102ULL },   /* Hamming */
+        { 0x34e4120ea5add03dULL, 0xd7124bbe683ecfc1ULL } }  /* Rectangular */
+    },
+    { "q15",
+      { { 0x8a1232ca91b235adULL, 0xdbd26cadd57de6fbULL },
+        { 0xc4e18da8ba7d8c09ULL, 0xcb40878c65688b06ULL },
+        { 0x1b6b43f0fb29c803ULL, 0x92069aac4ec21e3eULL },
+        { 0xd223552d8bcb6f90ULL, 0x9de006cb2c85ccfdULL },
+        { 0xe1a2cc11ef944fa4ULL, 0x3ed062cfe905c9edULL } }
+    },
+    { "folded",         /* the same as q15 */
+      { { 0x8a1232ca91b235adULL, 0xdbd26cadd57de6fbULL },
+        { 0xc4e18da8ba7d8c09ULL, 0xcb40878c65688b06ULL },
+        { 0x1b6b43f0fb29c803ULL, 0x92069aac4ec21e3eULL },
+        { 0xd223552d8bcb6f90ULL, 0x9de006cb2c85ccfdULL },
+        { 0xe1a2cc11ef944fa4ULL, 0x3ed062cfe905c9edULL } }
+    }
+};
+
+/* Kernels whose rounding depends on the plan FFTW picks, so that there is
+ * no one output to record */
+static const char* unrecorded[] = { "fft" };
+
+
+typedef struct
+{
+    int checks;
+    int failures;
+} selftest_count;
+
+
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char* p, size_t size)
+{
+    size_t i;
+
+    for (i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+
+static void check(selftest_count* count, int ok)
+{
+    count->checks++;
+    if (!ok)
+    {
+        count->failures++;
+    }
+}
+
+
+
+/* The convolution written out in the most obvious way, one channel and
+ * one output sample at a time. */
+static void reference_filter(const unsigned char* data, unsigned char* output,
+        long N, int C, const double* filt, int M)
+{
+    long n;
+    int k, c;
+    double sum;
+
+    for (c=0; c<C; c++)
+    {
+        for (n=0; n<N; n++)
+        {
+            sum = 0.0;
+            for (k=0; k<M; k++)
+            {
+                sum += ((double) data[(n + M - 1 - k)*C + c]) * filt[k];
+            }
+            if (sum > 255.0)
+            {
+                sum = 255.0;
+            }
+            else if (sum < 0.0)
+            {
+                sum = 0.0;
+            }
+            output[n*C + c] = sum;
+        }
+    }
+}
+
+
+
+static void test_kernels(selftest_count* count, unsigned char* input,
+        unsigned char* data, unsigned char* expected, unsigned char* output)
+{
+    double coeff[MAX_FILTER_LEN];
+    noise_gen gen;
+    const filter_kernel* kernel;
+    int type, t, b, ch, C, M, diff, worst;
+    long N, i;
+
+    for (type=BLACKMAN; type<=RECTANGULAR; type++)
+    {
+        for (t=0; t<COUNT(test_taps); t++)
+        {
+            M = test_taps[t];
+            computeFilterCoeff(type, coeff, M, 0.1 + 0.2*type);
+
+            for (b=0; b<COUNT(test_blocks); b++)
+            {
+                N = test_blocks[b];
+                if (M > N)
+                {
+                    continue;
+                }
+                for (ch=0; ch<COUNT(test_channels); ch++)
+                {
+                    C = test_channels[ch];
+                    noise_init(&gen, SELFTEST_SEED + type*1000 + t*100 + b*10 + ch, C);
+                    noise_fill(&gen, input, 2*N);
+                    reference_filter(input, expected, N, C, coeff, M);
+
+                    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+                    {
+                        memcpy(data, input, 2*N*C);
+                        filter_select(kernel->name);
+                        filter(data, output, N, C, coeff, M);
+
+                        worst = 0;
+                        for (i=0; i<N*C; i++)
+                        {
+                            diff = abs((int) output[i] - (int) expected[i]);
+                            if (diff > worst)
+                            {
+                                worst = diff;
+                            }
+                        }
+                        check(count, worst <= kernel->tolerance);
+                        if (worst > kernel->tolerance)
+                        {
+                            printf("FAIL: kernel %s, filter %d, M=%d, N=%ld, C=%d: "
+                                   "off by %d (tolerance %d)\n", kernel->name,
+                                   type, M, N, C, worst, kernel->tolerance);
+                        }
+
+                        /* The second half must become the history */
+                        check(count, memcmp(data, input + N*C, N*C) == 0);
+                        if (memcmp(data, input + N*C, N*C) != 0)
+                        {
+                            printf("FAIL: kernel %s, filter %d, M=%d, N=%ld, C=%d: "
+                                   "history not kept\n", kernel->name, type, M, N, C);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+
+/* noise_fill() must match the generator stepped one lane at a time,
+ * including across calls */
+static void test_noise(selftest_count* count, unsigned char* output, unsigned char* expected)
+{
+    static const long lengths[] = { 1, 5, 1000 };
+    noise_gen gen, ref;
+    long n, pos;
+    int C, c, l;
+
+    for (C=1; C<=MAX_CHANNELS; C++)
+    {
+        noise_init(&gen, SELFTEST_SEED + C, C);
+        noise_init(&ref, SELFTEST_SEED + C, C);
+        for (l=0; l<COUNT(lengths); l++)
+        {
+            noise_fill(&gen, output, lengths[l]);
+            for (n=0; n<lengths[l]; n++)
+            {
+                for (c=0; c<C; c++)
+                {
+                    ref.lane[c] = ref.lane[c] * LCG_MUL + LCG_INC;
+                    expected[n*C + c] = ref.lane[c] >> 56;
+                }
+            }
+            pos = lengths[l] * C;
+            check(count, memcmp(output, expected, pos) == 0);
+            if (memcmp(output, expected, pos) != 0)
+            {
+                printf("FAIL: noise, C=%d, %ld frames\n", C, lengths[l]);
+            }
+        }
+    }
+}
+
+
+
+/* Run the seeded signal path just as the main loop does, with each
+ * kernel, and compare checksums of the result.  The single-pass path
+ * must give the same stream with each kernel. */
+static void test_golden(selftest_count* count, unsigned char* data, unsigned char* output)
+{
+    double coeff[GOLDEN_LEN];
+    const filter_kernel* kernel;
+    const uint64_t* expected;
+    noise_gen gen;
+    fused_gen tiles;
+    uint64_t hash;
+    int type, C, b, g, u;
+
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        for (u=0; u<COUNT(unrecorded) && strcmp(unrecorded[u], kernel->name)!=0; u++)
+        {
+        }
+        if (u < COUNT(unrecorded))
+        {
+            continue;
+        }
+        for (g=0; g<COUNT(golden) && strcmp(golden[g].kernel, kernel->name)!=0; g++)
+        {
+        }
+        check(count, g < COUNT(golden));
+        if (g == COUNT(golden))
+        {
+            printf("FAIL: no recorded output for kernel %s\n", kernel->name);
+            continue;
+        }
+
+        filter_select(kernel->name);
+        for (type=BLACKMAN; type<=RECTANGULAR; type++)
+        {
+            computeFilterCoeff(type, coeff, GOLDEN_LEN, GOLDEN_CUTOFF);
+            for (C=1; C<=2; C++)
+            {
+                noise_init(&gen, SELFTEST_SEED, C);
+                noise_fill(&gen, data, GOLDEN_BLOCK_SIZE);
+                hash = FNV_OFFSET;
+                for (b=0; b<GOLDEN_BLOCKS; b++)
+                {
+                    noise_fill(&gen, data + GOLDEN_BLOCK_SIZE*C, GOLDEN_BLOCK_SIZE);
+                    filter(data, output, GOLDEN_BLOCK_SIZE, C, coeff, GOLDEN_LEN);
+                    hash = fnv1a(hash, output, GOLDEN_BLOCK_SIZE*C);
+                }
+
+                expected = &golden[g].sums[type][C-1];
+                check(count, hash == *expected);
+                if (hash != *expected)
+                {
+                    printf("FAIL: golden output, kernel %s, filter %d, C=%d: "
+                           "got 0x%016llxULL, expected 0x%016llxULL\n", kernel->name,
+                           type, C, (unsigned long long) hash,
+                           (unsigned long long) *expected);
+                }
+
+                noise_init(&gen, SELFTEST_SEED, C);
+                fused_init(&tiles, &gen, GOLDEN_LEN);
+                hash = FNV_OFFSET;
+                for (b=0; b<GOLDEN_BLOCKS; b++)
+                {
+                    fused_render(&tiles, &gen, output, GOLDEN_BLOCK_SIZE, coeff, GOLDEN_LEN,
+                                 NULL, 0.0);
+                    hash = fnv1a(hash, output, GOLDEN_BLOCK_SIZE*C);
+                }
+                check(count, hash == *expected);
+                if (hash != *expected)
+                {
+                    printf("FAIL: golden output, fused %s, filter %d, C=%d: "
+                           "got 0x%016llxULL\n", kernel->name, type, C,
+                           (unsigned long long) hash);
+                }
+            }
+        }
+    }
+}
+
+
+
+/* Stepping up from the IIR level crossfades from it, and the filter must
+ * run on through the fade just as if it were still playing */
+static void test_adapt(selftest_count* count, unsigned char* output)
+{
+    adapt_gen stepped, iir;
+    fused_gen* tiles[2];
+    noise_gen gen[2];
+    double coeff[GOLDEN_LEN];
+    arena mem;
+    long frames, done;
+    int C, f, b, compared, ok;
+
+    computeFilterCoeff(BLACKMAN, coeff, GOLDEN_LEN, GOLDEN_CUTOFF);
+    for (f=0; f<COUNT(adapt_frames); f++)
+    {
+        frames = adapt_frames[f];
+        for (C=1; C<=2; C++)
+        {
+            if (arena_init(&mem, 2 * (adapt_size(C, frames) +
+                                      ARENA_SPACE(sizeof(fused_gen))), 0) < 0)
+            {
+                check(count, 0);
+                printf("FAIL: adaptive, could not allocate\n");
+                continue;
+            }
+            tiles[0] = (fused_gen *) arena_alloc(&mem, sizeof(fused_gen));
+            tiles[1] = (fused_gen *) arena_alloc(&mem, sizeof(fused_gen));
+            adapt_init(&stepped, &mem, C, frames, ADAPT_TEST_RATE);
+            adapt_init(&iir, &mem, C, frames, ADAPT_TEST_RATE);
+            for (b=0; b<2; b++)
+            {
+                noise_init(&gen[b], SELFTEST_SEED, C);
+                fused_init(tiles[b], &gen[b], GOLDEN_LEN);
+            }
+            adapt_design(&stepped, BLACKMAN, GOLDEN_LEN, GOLDEN_CUTOFF);
+            adapt_design(&iir, BLACKMAN, GOLDEN_LEN, GOLDEN_CUTOFF);
+            adapt_force(&stepped, tiles[0], ADAPT_IIR);
+            adapt_force(&iir, tiles[1], ADAPT_IIR);
+
+            compared = 0;
+            ok = 1;
+            for (b=0; b<ADAPT_TEST_BLOCKS; b++)
+            {
+                if (b == 2)
+                {
+                    adapt_force(&stepped, tiles[0], ADAPT_IIR - 1);
+                }
+                done = stepped.fadeDone;
+                adapt_render(&stepped, tiles[0], &gen[0], output, coeff, NULL, 0.0);
+                adapt_render(&iir, tiles[1], &gen[1], output + frames*C, coeff, NULL, 0.0);
+                if (stepped.fadeDone != done)
+                {
+                    /* What was faded out against the IIR level left alone */
+                    ok = ok && memcmp(stepped.fadeBuf, output + frames*C, frames*C) == 0;
+                    compared++;
+                }
+            }
+            check(count, ok && compared > 1);
+            if (!ok || compared <= 1)
+            {
+                printf("FAIL: adaptive, fade from the IIR level, %ld frames, C=%d\n",
+                       frames, C);
+            }
+            arena_exit(&mem);
+        }
+    }
+}
+
+
+
+/* Run all the tests, reporting on stdout.  Returns the number of
+ * failures, or -1 if the tests could not be run. */
+int selftest(void)
+{
+    size_t size = 2 * SELFTEST_MAX_N * MAX_CHANNELS;
+    unsigned char *input, *data, *expected, *output;
+    selftest_count count = { 0, 0 };
+    const filter_kernel* kernel;
+    const filter_kernel* selected = filter_selected();
+
+    input    = (unsigned char *) malloc(size);
+    data     = (unsigned char *) malloc(size);
+    expected = (unsigned char *) malloc(size);
+    output   = (unsigned char *) malloc(size);
+    if (input == NULL || data == NULL || expected == NULL || output == NULL)
+    {
+        fprintf(stderr, "Error: could not allocate test buffers.\n");
+        free(input);
+        free(data);
+        free(expected);
+        free(output);
+        return -1;
+    }
+
+    printf("Filter kernels:");
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        printf(" %s", kernel->name);
+    }
+    printf("\n");
+
+    test_kernels(&count, input, data, expected, output);
+    test_noise(&count, output, expected);
+    test_golden(&count, data, output);
+    test_adapt(&count, output);
+    filter_select(selected->name);
+
+    printf("%d checks, %d failed.\n", count.checks, count.failures);
+
+    free(input);
+    free(data);
+    free(expected);
+    free(output);
+    return count.failures;
+}
+
+
+/* arch-tag: kernel self-test */
@@ -0,0 +1,208 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* shmclient.c
+ * Reader side of the shared-memory output, built as libwhitenoise-shm.
+ * Readers hand out pointers straight into the ring, so nothing is copied
+ * on the way.  The writer does not wait for anyone, so after using a
+ * stretch of frames a reader checks that the writer has not come round
+ * and overwritten them meanwhile.
+ *
+ * Functions return -1 and set errno on failure, and never print.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shmclient.h"
+
+
+
+/* Attach to the ring named 'name' (or the default, if NULL), starting at
+ * the newest frame */
+int shm_reader_attach(shm_reader* r, const char* name)
+{
+    char path[NAME_MAX];
+    struct stat st;
+    shmring_header* header;
+    int fd, err;
+
+    memset(r, 0, sizeof(shm_reader));
+    if (name == NULL)
+    {
+        name = SHMRING_DEFAULT_NAME;
+    }
+    if (snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name) >=
+        (int) sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    if ((fd = shm_open(path, O_RDONLY, 0)) < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(shmring_header))
+    {
+        err = errno != 0 ? errno : EINVAL;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    r->length = st.st_size;
+    r->map = mmap(NULL, r->length, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (r->map == MAP_FAILED)
+    {
+        r->map = NULL;
+        errno = err;
+        return -1;
+    }
+
+    /* The writer may still be setting up */
+    header = (shmring_header *) r->map;
+    if (atomic_load(&header->magic) != SHMRING_MAGIC ||
+        header->version != SHMRING_VERSION ||
+        header->offset + header->frames * header->channels > r->length)
+    {
+        err = atomic_load(&header->magic) != SHMRING_MAGIC ? EAGAIN : EPROTO;
+        shm_reader_detach(r);
+        errno = err;
+        return -1;
+    }
+
+    r->header = header;
+    r->ring   = (const unsigned char *) r->map + header->offset;
+    r->cursor = atomic_load(&header->written);
+    return 0;
+}
+
+
+
+void shm_reader_detach(shm_reader* r)
+{
+    if (r->map != NULL)
+    {
+        munmap(r->map, r->length);
+    }
+    r->map    = NULL;
+    r->header = NULL;
+}
+
+
+
+/* Point '*frames' at the next unread frames in the ring, and return how
+ * many there are in one piece: 0 if there are none yet, or -1 once the
+ * writer has gone and everything has been read.  A reader which has
+ * fallen too far behind skips ahead, and the frames it lost are added to
+ * 'dropped'. */
+long shm_reader_peek(shm_reader* r, const unsigned char** frames)
+{
+    shmring_header* header = r->header;
+    uint64_t w, pos, limit;
+
+    w = atomic_load(&header->written);
+    limit = header->frames - header->slack;
+    if (w - r->cursor > limit)
+    {
+        r->dropped += w - header->slack - r->cursor;
+        r->cursor   = w - header->slack;
+    }
+
+    if (w == r->cursor)
+    {
+        if (atomic_load(&header->closed))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+        return 0;
+    }
+
+    pos = r->cursor & (header->frames - 1);
+    *frames = r->ring + pos * header->channels;
+    return (long) (w - r->cursor < header->frames - pos ? w - r->cursor : header->frames - pos);
+}
+
+
+
+/* Finish with 'n' frames returned by shm_reader_peek().  Returns 0 if
+ * they were intact throughout, or -1 (with errno ESTALE) if the writer
+ * may have overwritten some of them while they were in use. */
+int shm_reader_consume(shm_reader* r, long n)
+{
+    shmring_header* header = r->header;
+    uint64_t w;
+
+    /* Order the caller's reads of the frames before the count; see
+     * shmring.h.  The writer may be filling up to 'slack' frames past
+     * 'written'. */
+    atomic_thread_fence(memory_order_acquire);
+    w = atomic_load(&header->written);
+    r->cursor += n;
+    if (w + header->slack > r->cursor - n + header->frames)
+    {
+        errno = ESTALE;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/* Sleep until there are frames to read, or for up to 'timeout' ms.
+ * Returns 1 if there are, 0 on timeout or a signal, or -1 once the
+ * writer has gone. */
+int shm_reader_wait(shm_reader* r, int timeout)
+{
+    shmring_header* header = r->header;
+    struct timespec ts;
+    unsigned int seen;
+
+    seen = atomic_load(&header->wake);
+    if (atomic_load(&header->written) != r->cursor)
+    {
+        return 1;
+    }
+    if (atomic_load(&header->closed))
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    syscall(SYS_futex, &header->wake, FUTEX_WAIT, seen, &ts, NULL, 0);
+
+    return atomic_load(&header->written) != r->cursor ? 1 : 0;
+}
+
+
+/* arch-tag: shared-memory reader */
@@ -0,0 +1,67 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef SHMCLIENT_H
+#define SHMCLIENT_H 1
+
+#include <stdint.h>
+#include "shmring.h"
+
+/* Reads the noise published by "whitenoise -o shm[:NAME]".  Samples are
+ * unsigned 8-bit and interleaved, 'header->channels' to a frame, at
+ * 'header->rate' frames per second.  A typical reader:
+ *
+ *     shm_reader r;
+ *     const unsigned char* frames;
+ *     long n;
+ *
+ *     shm_reader_attach(&r, NULL);
+ *     while ((n = shm_reader_peek(&r, &frames)) >= 0)
+ *     {
+ *         if (n == 0)
+ *         {
+ *             shm_reader_wait(&r, 1000);
+ *             continue;
+ *         }
+ *         use(frames, n);
+ *         shm_reader_consume(&r, n);
+ *     }
+ *     shm_reader_detach(&r);
+ */
+typedef struct
+{
+    void* map;
+    size_t length;
+    shmring_header* header;
+    const unsigned char* ring;
+    uint64_t cursor;        /* next frame to read */
+    uint64_t dropped;       /* frames skipped after falling behind */
+} shm_reader;
+
+
+int  shm_reader_attach( shm_reader*, const char* );
+void shm_reader_detach( shm_reader* );
+long shm_reader_peek( shm_reader*, const unsigned char** );
+int  shm_reader_consume( shm_reader*, long );
+int  shm_reader_wait( shm_reader*, int );
+
+
+#endif
+
+
+/* arch-tag: shared-memory reader (header) */
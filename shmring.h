@@ -0,0 +1,70 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef SHMRING_H
+#define SHMRING_H 1
+
+/* Layout of the shared-memory ring written by the "shm" output, and read
+ * through shmclient.h.  One writer publishes frames of unsigned 8-bit,
+ * interleaved samples; any number of readers follow it, each with its own
+ * cursor in its own memory.  The writer never waits for the readers, and
+ * a reader which falls more than 'frames - slack' behind has lost data.
+ * Readers map the object read-only.
+ *
+ * Whether a reader's copy is intact is checked as with a seqlock, with
+ * 'written' as the sequence.  The writer publishes 'written', then
+ * issues a release fence before copying the next chunk over the oldest
+ * frames, so that nobody can see those stores without seeing the count
+ * that came before them.  A reader copies frames out, issues an acquire
+ * fence, and loads 'written' again: if the writer may have reached the
+ * frames it copied, by then up to 'slack' past that count, the copy is
+ * discarded.  Without the fences this only holds on strongly ordered
+ * CPUs such as x86. */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SHMRING_MAGIC   0x574e5348  /* "WNSH" */
+#define SHMRING_VERSION 1
+
+/* Object name used when none is given */
+#define SHMRING_DEFAULT_NAME "/whitenoise"
+
+
+typedef struct
+{
+    atomic_uint magic;      /* stored last, once the rest is set up */
+    uint32_t version;
+    uint32_t channels;
+    atomic_uint rate;       /* may change while running */
+    uint64_t frames;        /* ring size in frames, a power of two */
+    uint64_t slack;         /* most frames published at once */
+    uint64_t offset;        /* of the ring from the start of the object */
+    int32_t pid;            /* of the writer */
+    atomic_uint closed;     /* set when the writer goes away */
+
+    /* Written on every publish; kept on a line of their own */
+    _Alignas(64) atomic_ullong written;     /* frames published, ever */
+    atomic_uint wake;       /* futex, bumped after every publish */
+} shmring_header;
+
+
+#endif
+
+
+/* arch-tag: shared-memory ring layout */
@@ -0,0 +1,341 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* spectral.c
+ * Synthesizes noise directly in the frequency domain, so that any
+ * spectral shape costs the same: notches, tilts and measured room curves
+ * as well as lowpasses.  Each frame of SPECTRAL_SIZE samples is built from
+ * the magnitude curve with a random phase in every bin, transformed back
+ * with FFTW, and overlap-added at half its length under the square root
+ * of a Hann window.  The squared windows of overlapping frames sum to one,
+ * so the noise keeps a steady level across frames.
+ *
+ * The magnitude curve is interpolated between breakpoints in dB, on a log
+ * frequency scale, and held flat beyond the first and last.  It is scaled
+ * so that the noise has the same RMS level whatever its shape.
+ */
+
+#include "spectral.h"
+
+#ifdef HAS_FFTW3
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* RMS of the output around 128.  The noise is close to Gaussian, so this
+ * leaves four standard deviations before clipping; it is a dB or so below
+ * the default lowpass. */
+#define SPECTRAL_LEVEL 32.0
+
+#define SPECTRAL_BINS (SPECTRAL_SIZE/2 + 1)
+#define SPECTRAL_HOP  (SPECTRAL_SIZE/2)
+
+#define SPECTRAL_LINE 256
+
+
+
+/* Add the breakpoint 'freq' Hz, 'level' dB.  Returns -1 if it is out of
+ * order or there are too many. */
+static int spectral_point(spectral_gen* sg, double freq, double level)
+{
+    if (sg->points == SPECTRAL_POINTS)
+    {
+        fprintf(stderr, "Error: a shape can have at most %d breakpoints.\n", SPECTRAL_POINTS);
+        return -1;
+    }
+    if (freq <= 0.0 || (sg->points > 0 && freq <= sg->freq[sg->points - 1]))
+    {
+        fprintf(stderr, "Error: shape frequencies must be positive and increasing.\n");
+        return -1;
+    }
+    sg->freq[sg->points]  = freq;
+    sg->level[sg->points] = level;
+    sg->points++;
+    return 0;
+}
+
+
+
+/* Read breakpoints from 'f', one "FREQ DB" pair per line.  Blank lines
+ * and anything after a '#' are ignored. */
+static int spectral_read(spectral_gen* sg, FILE* f, const char* name)
+{
+    char line[SPECTRAL_LINE];
+    char* hash;
+    double freq, level;
+    char extra;
+    int n = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        n++;
+        if ((hash = strchr(line, '#')) != NULL)
+        {
+            *hash = '\0';
+        }
+        switch (sscanf(line, "%lf %lf %c", &freq, &level, &extra))
+        {
+            case EOF:
+                continue;
+            case 2:
+                if (spectral_point(sg, freq, level) < 0)
+                {
+                    return -1;
+                }
+                continue;
+            default:
+                fprintf(stderr, "Error: %s, line %d: expected \"FREQ DB\".\n", name, n);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+
+
+/* Take the shape from 'spec': the name of a file of breakpoints, or a
+ * list of them such as "100:0,1000:-6,8000:-30".  Returns -1, with a
+ * message, if it cannot be used. */
+int spectral_parse(spectral_gen* sg, const char* spec)
+{
+    double freq, level;
+    FILE* f;
+    int n, status = 0;
+
+    memset(sg, 0, sizeof(spectral_gen));
+    if ((f = fopen(spec, "r")) != NULL)
+    {
+        status = spectral_read(sg, f, spec);
+        fclose(f);
+    }
+    else
+    {
+        while (*spec != '\0' && status == 0)
+        {
+            if (sscanf(spec, "%lf:%lf%n", &freq, &level, &n) != 2 ||
+                (spec[n] != ',' && spec[n] != '\0'))
+            {
+                fprintf(stderr, "Error: shape must be a file, or breakpoints like "
+                                "\"100:0,1000:-6\".\n");
+                return -1;
+            }
+            status = spectral_point(sg, freq, level);
+            spec += spec[n] == ',' ? n + 1 : n;
+        }
+    }
+    if (status == 0 && sg->points == 0)
+    {
+        fprintf(stderr, "Error: the shape has no breakpoints.\n");
+        status = -1;
+    }
+    return status;
+}
+
+
+
+/* Room needed in the arena by spectral_init() */
+size_t spectral_size(int channels)
+{
+    return ARENA_SPACE(SPECTRAL_BINS * sizeof(double)) +
+           ARENA_SPACE(SPECTRAL_SIZE * sizeof(double)) +
+           ARENA_SPACE(2 * SPECTRAL_PHASES * sizeof(double)) +
+           ARENA_SPACE(2 * SPECTRAL_BINS * channels) +
+           ARENA_SPACE(SPECTRAL_BINS * sizeof(fftw_complex)) +
+           ARENA_SPACE(SPECTRAL_SIZE * sizeof(double)) +
+           ARENA_SPACE(SPECTRAL_HOP * channels * sizeof(double)) +
+           ARENA_SPACE(SPECTRAL_HOP * channels);
+}
+
+
+
+/* Set up for 'channels' channels at 'rate' Hz, with buffers from 'mem',
+ * once the shape has been parsed.  Returns -1 on failure. */
+int spectral_init(spectral_gen* sg, arena* mem, int channels, int rate)
+{
+    int i;
+
+    sg->channels = channels;
+    if ((sg->magnitude = (double *) arena_alloc(mem, SPECTRAL_BINS * sizeof(double))) == NULL ||
+        (sg->window = (double *) arena_alloc(mem, SPECTRAL_SIZE * sizeof(double))) == NULL ||
+        (sg->phase = (double *) arena_alloc(mem, 2 * SPECTRAL_PHASES * sizeof(double))) == NULL ||
+        (sg->random = (unsigned char *) arena_alloc(mem, 2 * SPECTRAL_BINS * channels)) == NULL ||
+        (sg->spectrum = (fftw_complex *) arena_alloc(mem, SPECTRAL_BINS *
+                                                          sizeof(fftw_complex))) == NULL ||
+        (sg->frame = (double *) arena_alloc(mem, SPECTRAL_SIZE * sizeof(double))) == NULL ||
+        (sg->overlap = (double *) arena_alloc(mem, SPECTRAL_HOP * channels *
+                                                   sizeof(double))) == NULL ||
+        (sg->ready = (unsigned char *) arena_alloc(mem, SPECTRAL_HOP * channels)) == NULL ||
+        (sg->inverse = fft_plan_c2r(SPECTRAL_SIZE, sg->spectrum, sg->frame)) == NULL)
+    {
+        return -1;
+    }
+
+    for (i=0; i<SPECTRAL_SIZE; i++)
+    {
+        sg->window[i] = sin(M_PI * i / SPECTRAL_SIZE);
+    }
+    for (i=0; i<SPECTRAL_PHASES; i++)
+    {
+        sg->phase[2*i]     = cos(2.0 * M_PI * i / SPECTRAL_PHASES);
+        sg->phase[2*i + 1] = sin(2.0 * M_PI * i / SPECTRAL_PHASES);
+    }
+    spectral_set_rate(sg, rate);
+
+    printf("Shaping the noise with %d breakpoint%s, %g Hz to %g Hz.\n", sg->points,
+           sg->points == 1 ? "" : "s", sg->freq[0], sg->freq[sg->points - 1]);
+    return 0;
+}
+
+
+
+/* Level of the curve at 'freq' Hz, in dB */
+static double spectral_level(spectral_gen* sg, double freq)
+{
+    int i;
+    double t;
+
+    if (freq <= sg->freq[0])
+    {
+        return sg->level[0];
+    }
+    for (i=1; i<sg->points; i++)
+    {
+        if (freq < sg->freq[i])
+        {
+            t = log(freq / sg->freq[i-1]) / log(sg->freq[i] / sg->freq[i-1]);
+            return sg->level[i-1] + t * (sg->level[i] - sg->level[i-1]);
+        }
+    }
+    return sg->level[sg->points - 1];
+}
+
+
+
+/* Lay the curve over the bins for 'rate' Hz.  DC and Nyquist are left
+ * empty, which keeps the noise centred. */
+void spectral_set_rate(spectral_gen* sg, int rate)
+{
+    double power = 0.0, gain;
+    int k;
+
+    sg->rate = rate;
+    sg->magnitude[0] = 0.0;
+    sg->magnitude[SPECTRAL_BINS - 1] = 0.0;
+    for (k=1; k<SPECTRAL_BINS - 1; k++)
+    {
+        sg->magnitude[k] = pow(10.0, spectral_level(sg, (double) k * rate / SPECTRAL_SIZE) / 20.0);
+        power += sg->magnitude[k] * sg->magnitude[k];
+    }
+
+    /* A bin of magnitude A and random phase gives a variance of 2 A^2 in
+     * the unnormalized inverse transform */
+    gain = SPECTRAL_LEVEL / sqrt(2.0 * power);
+    for (k=1; k<SPECTRAL_BINS - 1; k++)
+    {
+        sg->magnitude[k] *= gain;
+    }
+}
+
+
+
+/* Synthesize the next SPECTRAL_HOP frames into 'ready' */
+static void spectral_frame(spectral_gen* sg, noise_gen* noise)
+{
+    int C = sg->channels;
+    const unsigned char* r;
+    double* w = sg->window;
+    double sum;
+    int c, k, p;
+    long i;
+
+    /* Two random bytes per bin and channel give the phases */
+    noise_fill(noise, sg->random, 2 * SPECTRAL_BINS);
+
+    for (c=0; c<C; c++)
+    {
+        r = sg->random + c;
+        for (k=0; k<SPECTRAL_BINS; k++)
+        {
+            p = ((r[2*k*C] << 8 | r[(2*k + 1)*C]) % SPECTRAL_PHASES) * 2;
+            sg->spectrum[k][0] = sg->magnitude[k] * sg->phase[p];
+            sg->spectrum[k][1] = sg->magnitude[k] * sg->phase[p + 1];
+        }
+        fftw_execute_dft_c2r(sg->inverse, sg->spectrum, sg->frame);
+
+        for (i=0; i<SPECTRAL_HOP; i++)
+        {
+            sum = 128.5 + sg->overlap[i*C + c] + w[i] * sg->frame[i];
+            sg->ready[i*C + c] = sum > 255.0 ? 255 : (sum < 0.0 ? 0 : sum);
+            sg->overlap[i*C + c] = w[SPECTRAL_HOP + i] * sg->frame[SPECTRAL_HOP + i];
+        }
+    }
+    sg->used = 0;
+}
+
+
+
+/* Start the noise from 'noise'.  The first frame only fades in, so it is
+ * made and thrown away, and the output starts at its full level. */
+void spectral_start(spectral_gen* sg, noise_gen* noise)
+{
+    memset(sg->overlap, 0, SPECTRAL_HOP * sg->channels * sizeof(double));
+    spectral_frame(sg, noise);
+    sg->used = SPECTRAL_HOP;
+}
+
+
+
+/* Write 'frames' frames of shaped noise to 'out' */
+void spectral_render(spectral_gen* sg, noise_gen* noise, unsigned char* out, long frames)
+{
+    int C = sg->channels;
+    long n;
+
+    while (frames > 0)
+    {
+        if (sg->used == SPECTRAL_HOP)
+        {
+            spectral_frame(sg, noise);
+        }
+        n = SPECTRAL_HOP - sg->used < frames ? SPECTRAL_HOP - sg->used : frames;
+        memcpy(out, sg->ready + sg->used*C, n*C);
+        sg->used += n;
+        out      += n*C;
+        frames   -= n;
+    }
+}
+
+
+
+/* The buffers belong to the arena; only the plan is released here, which
+ * FFTW needs before fft_exit() */
+void spectral_exit(spectral_gen* sg)
+{
+    if (sg->inverse != NULL)
+    {
+        fft_destroy_plan(sg->inverse);
+        sg->inverse = NULL;
+    }
+}
+
+#endif /* HAS_FFTW3 */
+
+
+/* arch-tag: frequency-domain noise synthesis */
@@ -0,0 +1,76 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef SPECTRAL_H
+#define SPECTRAL_H 1
+
+#include "fft.h"
+
+#ifdef HAS_FFTW3
+#include <stddef.h>
+#include "arena.h"
+#include "noise.h"
+
+/* Transform length; each transform yields half as many new frames */
+#define SPECTRAL_SIZE 4096
+
+/* Most breakpoints in a shape */
+#define SPECTRAL_POINTS 256
+
+/* Resolution of the random phases */
+#define SPECTRAL_PHASES 4096
+
+
+/* Synthesizes noise with any spectrum, from a magnitude curve given as
+ * breakpoints in Hz and dB */
+typedef struct
+{
+    int channels;
+    int rate;
+
+    int points;
+    double freq[SPECTRAL_POINTS];
+    double level[SPECTRAL_POINTS];      /* in dB */
+
+    double* magnitude;      /* per bin, scaled to the output level */
+    double* window;         /* square root of a Hann window */
+    double* phase;          /* cos and sin of each phase step, in pairs */
+    unsigned char* random;  /* two bytes per bin and channel */
+    fftw_complex* spectrum;
+    double* frame;
+    double* overlap;        /* second halves of the last frames, interleaved */
+    unsigned char* ready;   /* finished frames, interleaved */
+    long used;              /* frames of 'ready' handed out so far */
+    fftw_plan inverse;
+} spectral_gen;
+
+
+int  spectral_parse( spectral_gen*, const char* );
+size_t spectral_size( int );
+int  spectral_init( spectral_gen*, arena*, int, int );
+void spectral_set_rate( spectral_gen*, int );
+void spectral_start( spectral_gen*, noise_gen* );
+void spectral_render( spectral_gen*, noise_gen*, unsigned char*, long );
+void spectral_exit( spectral_gen* );
+#endif
+
+
+#endif
+
+
+/* arch-tag: frequency-domain noise synthesis (header) */
@@ -0,0 +1,485 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* tune.c
+ * Chooses the fastest filter kernel by timing each of them on this
+ * machine.  Which one wins depends on the filter length, the channel count
+ * and block size, and the CPU, so the choice is remembered for each
+ * configuration, in a file in ~/.whitenoise named after the host.  Each
+ * configuration is then only timed once.
+ *
+ * The choices are read in by tune_init() and written back by tune_exit(),
+ * and the timing runs on buffers from the arena.  Timing every kernel
+ * takes longer than a low-latency buffer lasts, so a choice asked for
+ * while playing is made by a helper thread: the audio loop only looks up
+ * the table, and keeps the current kernel until the timing is done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tune.h"
+#include "filter.h"
+#include "noise.h"
+#include "rt.h"
+#include "userdir.h"
+
+/* Each kernel runs for TUNE_ROUNDS slices of TUNE_SLICE ns, and is judged
+ * by its best slice */
+#define TUNE_ROUNDS 3
+#define TUNE_SLICE  2000000.0
+
+/* Configurations remembered; the oldest are forgotten first */
+#define TUNE_ENTRIES 256
+
+#define TUNE_LINE 128
+
+
+/* One line of the file: "M C FRAMES EXACT KERNEL" */
+typedef struct
+{
+    int M;
+    int C;
+    long frames;
+    int exact;
+    char kernel[32];
+} tune_entry;
+
+
+static tune_entry tune_table[TUNE_ENTRIES];
+static int tune_count = 0;
+static int tune_changed = 0;
+static char* tune_file = NULL;
+
+/* Noise to time the kernels on, and somewhere to put the result */
+static unsigned char* tune_in = NULL;
+static unsigned char* tune_out = NULL;
+static int tune_channels;
+static long tune_frames;
+
+/* The helper thread, and the timing asked of it by tune_request().  The
+ * lock also guards the table once the thread is running. */
+static pthread_t tune_thread;
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tune_wake = PTHREAD_COND_INITIALIZER;
+static int tune_running = 0;
+static int tune_pending = 0;
+static int tune_generation = 0;
+static double tune_coeff[MAX_FILTER_LEN];
+static int tune_M;
+static int tune_exact;
+
+
+
+static char* tune_path(void)
+{
+    char host[HOST_NAME_MAX + 1];
+    char name[sizeof(TUNE_NAME) + HOST_NAME_MAX + 1];
+
+    if (gethostname(host, sizeof(host)) < 0)
+    {
+        strcpy(host, "localhost");
+    }
+    host[HOST_NAME_MAX] = '\0';
+    snprintf(name, sizeof(name), "%s%s", TUNE_NAME, host);
+    return userdir_path(name);
+}
+
+
+
+/* Room needed in the arena by tune_init() */
+size_t tune_size(int C, long frames)
+{
+    return ARENA_SPACE((frames + MAX_FILTER_LEN - 1) * C) + ARENA_SPACE(frames * C);
+}
+
+
+
+static void* tune_worker(void* arg);
+
+
+/* Get ready to time kernels on blocks of 'frames' frames of 'C' channels,
+ * read the choices made before, and start the helper thread.  Returns -1
+ * if 'mem' is too small. */
+int tune_init(arena* mem, int C, long frames)
+{
+    char line[TUNE_LINE];
+    tune_entry* e;
+    noise_gen gen;
+    FILE* f;
+
+    tune_channels = C;
+    tune_frames   = frames;
+    if ((tune_in  = (unsigned char *) arena_alloc(mem, (frames + MAX_FILTER_LEN - 1) * C)) == NULL ||
+        (tune_out = (unsigned char *) arena_alloc(mem, frames * C)) == NULL)
+    {
+        return -1;
+    }
+    noise_init(&gen, 0, C);
+    noise_fill(&gen, tune_in, frames + MAX_FILTER_LEN - 1);
+
+    tune_count   = 0;
+    tune_changed = 0;
+    tune_file    = tune_path();
+    if (tune_file != NULL && (f = fopen(tune_file, "r")) != NULL)
+    {
+        while (tune_count < TUNE_ENTRIES && fgets(line, sizeof(line), f) != NULL)
+        {
+            e = &tune_table[tune_count];
+            if (sscanf(line, "%d %d %ld %d %31s", &e->M, &e->C, &e->frames, &e->exact,
+                       e->kernel) == 5)
+            {
+                tune_count++;
+            }
+        }
+        fclose(f);
+    }
+
+    /* Without the thread, tune_request() can only use the table */
+    tune_pending = 0;
+    tune_running = 1;
+    if (pthread_create(&tune_thread, NULL, tune_worker, NULL) != 0)
+    {
+        tune_running = 0;
+    }
+    return 0;
+}
+
+
+
+/* Stop the helper thread, abandoning any timing under way, and write
+ * back the choices, if any were made */
+void tune_exit(void)
+{
+    char* temp;
+    FILE* f;
+    int i;
+
+    if (tune_running)
+    {
+        pthread_mutex_lock(&tune_lock);
+        tune_running = 0;
+        tune_generation++;
+        pthread_cond_signal(&tune_wake);
+        pthread_mutex_unlock(&tune_lock);
+        pthread_join(tune_thread, NULL);
+    }
+
+    if (tune_changed && tune_file != NULL &&
+        (temp = (char *) malloc(strlen(tune_file) + 5)) != NULL)
+    {
+        sprintf(temp, "%s.tmp", tune_file);
+        if ((f = fopen(temp, "w")) != NULL)
+        {
+            for (i=0; i<tune_count; i++)
+            {
+                fprintf(f, "%d %d %ld %d %s\n", tune_table[i].M, tune_table[i].C,
+                        tune_table[i].frames, tune_table[i].exact, tune_table[i].kernel);
+            }
+            if (fclose(f) != 0 || rename(temp, tune_file) < 0)
+            {
+                f = NULL;
+                unlink(temp);
+            }
+        }
+        if (f == NULL)
+        {
+            fprintf(stderr, "Warning: could not save the kernel timings.\n");
+        }
+        free(temp);
+    }
+    free(tune_file);
+    tune_file    = NULL;
+    tune_changed = 0;
+}
+
+
+
+static tune_entry* tune_find(int M, int exact)
+{
+    int i;
+
+    for (i=0; i<tune_count; i++)
+    {
+        if (tune_table[i].M == M && tune_table[i].C == tune_channels &&
+            tune_table[i].frames == tune_frames && tune_table[i].exact == exact)
+        {
+            return &tune_table[i];
+        }
+    }
+    return NULL;
+}
+
+
+
+/* The kernel recorded for a configuration, or NULL if there is none, or
+ * it is no longer built in */
+static const filter_kernel* tune_lookup(int M, int exact)
+{
+    const filter_kernel* kernel;
+    tune_entry* e;
+
+    if ((e = tune_find(M, exact)) == NULL)
+    {
+        return NULL;
+    }
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        if (strcmp(kernel->name, e->kernel) == 0 && (kernel->exact || !exact))
+        {
+            return kernel;
+        }
+    }
+    return NULL;
+}
+
+
+
+/* Record the choice for a configuration, replacing any earlier one */
+static void tune_store(int M, int exact, const char* name)
+{
+    tune_entry* e;
+
+    if ((e = tune_find(M, exact)) == NULL)
+    {
+        if (tune_count == TUNE_ENTRIES)
+        {
+            memmove(tune_table, tune_table + 1, (TUNE_ENTRIES - 1) * sizeof(tune_entry));
+            tune_count--;
+        }
+        e = &tune_table[tune_count++];
+    }
+    e->M      = M;
+    e->C      = tune_channels;
+    e->frames = tune_frames;
+    e->exact  = exact;
+    snprintf(e->kernel, sizeof(e->kernel), "%s", name);
+    tune_changed = 1;
+}
+
+
+
+/* Millions of frames filtered per second */
+static double tune_time(const filter_kernel* kernel, double* coeff, int M)
+{
+    struct timespec t0, t1;
+    double elapsed, rate, best = 0.0;
+    long calls;
+    int r;
+
+    /* Warm the caches, and let the kernel set itself up */
+    kernel->run(tune_in, tune_out, tune_frames, tune_channels, coeff, M);
+
+    for (r=0; r<TUNE_ROUNDS; r++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        calls = 0;
+        do
+        {
+            kernel->run(tune_in, tune_out, tune_frames, tune_channels, coeff, M);
+            calls++;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            elapsed = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+        } while (elapsed < TUNE_SLICE);
+
+        rate = (double) calls * tune_frames / elapsed * 1e3;
+        if (rate > best)
+        {
+            best = rate;
+        }
+    }
+    return best;
+}
+
+
+
+/* A timing asked for by tune_request() is abandoned when a newer one is
+ * asked for, or the thread is stopped */
+static int tune_superseded(int generation)
+{
+    int superseded;
+
+    if (generation < 0)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&tune_lock);
+    superseded = generation != tune_generation;
+    pthread_mutex_unlock(&tune_lock);
+
+    return superseded;
+}
+
+
+
+/* Time the kernels on the 'M' taps 'coeff', and return the fastest, or
+ * NULL if none could be timed or the timing for 'generation' was
+ * superseded (a negative 'generation' never is) */
+static const filter_kernel* tune_fastest(double* coeff, int M, int flags, int generation)
+{
+    const filter_kernel* kernel;
+    const filter_kernel* best = NULL;
+    double rate, bestRate = 0.0;
+
+    if (flags & TUNE_REPORT)
+    {
+        printf("Timing the filter kernels on blocks of %ld frames:\n", tune_frames);
+    }
+    for (kernel=filter_kernels; kernel->name!=NULL; kernel++)
+    {
+        if ((flags & TUNE_EXACT) && !kernel->exact)
+        {
+            continue;
+        }
+        if (tune_superseded(generation))
+        {
+            return NULL;
+        }
+        rate = tune_time(kernel, coeff, M);
+        if (flags & TUNE_REPORT)
+        {
+            printf("    %-8s %8.1f million frames/s\n", kernel->name, rate);
+        }
+        if (rate > bestRate)
+        {
+            best     = kernel;
+            bestRate = rate;
+        }
+    }
+    return best;
+}
+
+
+
+static void* tune_worker(void* arg)
+{
+    double coeff[MAX_FILTER_LEN];
+    const filter_kernel* best;
+    int M, flags, generation;
+
+    rt_demote();
+
+    pthread_mutex_lock(&tune_lock);
+    while (tune_running)
+    {
+        if (!tune_pending)
+        {
+            pthread_cond_wait(&tune_wake, &tune_lock);
+            continue;
+        }
+        M          = tune_M;
+        flags      = tune_exact ? TUNE_EXACT : 0;
+        generation = tune_generation;
+        memcpy(coeff, tune_coeff, M * sizeof(double));
+        tune_pending = 0;
+        pthread_mutex_unlock(&tune_lock);
+
+        best = tune_fastest(coeff, M, flags, generation);
+
+        pthread_mutex_lock(&tune_lock);
+        if (best != NULL && generation == tune_generation)
+        {
+            filter_select(best->name);
+            printf("Filtering with the %s kernel, the fastest here.\n", best->name);
+            tune_store(M, (flags & TUNE_EXACT) != 0, best->name);
+        }
+    }
+    pthread_mutex_unlock(&tune_lock);
+
+    return NULL;
+}
+
+
+
+/* Select the fastest kernel for the 'M' taps 'coeff', on the blocks given
+ * to tune_init().  A choice made before for the same configuration is used
+ * unless 'flags' has TUNE_MEASURE.  Returns 0, or -1 if nothing could be
+ * timed, in which case the selection is left alone.  Not for use while
+ * playing; see tune_request(). */
+int tune_kernel(double* coeff, int M, int flags)
+{
+    const filter_kernel* best;
+    int exact = (flags & TUNE_EXACT) != 0;
+
+    if (tune_in == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&tune_lock);
+    best = (flags & TUNE_MEASURE) ? NULL : tune_lookup(M, exact);
+    pthread_mutex_unlock(&tune_lock);
+    if (best != NULL)
+    {
+        filter_select(best->name);
+        printf("Filtering with the %s kernel, found fastest before.\n", best->name);
+        return 0;
+    }
+
+    if ((best = tune_fastest(coeff, M, flags, -1)) == NULL)
+    {
+        return -1;
+    }
+    filter_select(best->name);
+    printf("Filtering with the %s kernel, the fastest here.\n", best->name);
+    pthread_mutex_lock(&tune_lock);
+    tune_store(M, exact, best->name);
+    pthread_mutex_unlock(&tune_lock);
+    return 0;
+}
+
+
+
+/* tune_kernel() for the audio loop.  A choice made before is selected at
+ * once; otherwise the current kernel carries on, and the helper thread
+ * times the kernels and selects the fastest when it is done.  Any timing
+ * still under way for an earlier request is abandoned. */
+void tune_request(double* coeff, int M, int flags)
+{
+    const filter_kernel* best;
+    int exact = (flags & TUNE_EXACT) != 0;
+
+    if (tune_in == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&tune_lock);
+    tune_generation++;
+    if ((best = tune_lookup(M, exact)) == NULL && tune_running)
+    {
+        memcpy(tune_coeff, coeff, M * sizeof(double));
+        tune_M       = M;
+        tune_exact   = exact;
+        tune_pending = 1;
+        pthread_cond_signal(&tune_wake);
+    }
+    pthread_mutex_unlock(&tune_lock);
+
+    if (best != NULL)
+    {
+        filter_select(best->name);
+        printf("Filtering with the %s kernel, found fastest before.\n", best->name);
+    }
+}
+
+
+/* arch-tag: filter kernel autotuning */
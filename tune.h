@@ -0,0 +1,43 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef TUNE_H
+#define TUNE_H 1
+
+#include <stddef.h>
+#include "arena.h"
+
+/* Timings are kept in ~/.whitenoise, in a file for each host */
+#define TUNE_NAME "kernels-"
+
+/* Flags for tune_kernel() */
+#define TUNE_MEASURE 1      /* time the kernels even if already known */
+#define TUNE_REPORT  2      /* print every timing */
+#define TUNE_EXACT   4      /* only kernels which give the default output */
+
+size_t tune_size( int, long );
+int  tune_init( arena*, int, long );
+int  tune_kernel( double*, int, int );
+void tune_request( double*, int, int );
+void tune_exit( void );
+
+
+#endif
+
+
+/* arch-tag: filter kernel autotuning (header) */
@@ -0,0 +1,73 @@
+/*  whitenoise -- A command-line ambient random noise generator.
+    Copyright (C) 2001, 2002, 2004, 2010 Paul Pelzl
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/* userdir.c
+ * Locates files in the per-user data directory, ~/.whitenoise .
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "userdir.h"
+
+
+/* Return the full path of 'name' within ~/.whitenoise, creating the
+ * directory (and any subdirectory leading up to 'name') as needed.  The
+ * result must be freed by the caller.  Returns NULL on error. */
+char * userdir_path(const char* name)
+{
+    const char* home_path;
+    char* path;
+    char* slash;
+
+    home_path = getenv("HOME");
+    if (home_path == NULL)
+    {
+        home_path = ".";
+    }
+
+    if ((path = (char *) malloc(strlen(home_path) + strlen(USERDIR_RELPATH) +
+                    strlen(name) + 2)) == NULL)
+    {
+        return NULL;
+    }
+    sprintf(path, "%s%s/%s", home_path, USERDIR_RELPATH, name);
+
+    /* Create every directory component after $HOME */
+    slash = path + strlen(home_path);
+    while ((slash = strchr(slash + 1, '/')) != NULL)
+    {
+        *slash = '\0';
+        if (mkdir(path, 0744) < 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "Could not create \"%s\".\n", path);
+            free(path);
+            return NULL;
+        }
+        *slash = '/';
+    }
+
+    return path;
+}
+
+
+/* arch-tag: per-user data directory */
@@ -24,12 +24,24 @@
 #include <string.h>
 #include <signal.h>
 #include "filter.h"
+#include "fused.h"
 #include "audio.h"
+#include "loop.h"
+#include "noise.h"
+#include "rt.h"
+#include "selftest.h"
+#include "multirate.h"
+#include "render.h"
+#include "tune.h"
+#include "arena.h"
+#include "adapt.h"
 
 
 #ifdef HAS_FFTW3
-#include <fftw3.h>
+#include "fft.h"
 #include "plot.h"
+#include "analyzer.h"
+#include "spectral.h"
 #endif
 
 #define SAMPLE_SIZE 1024
@@ -44,6 +56,25 @@
 #define DEFAULT_FADE_TIME   (-1)
 #define DEFAULT_PLOT_WIDTH  320
 #define DEFAULT_LATENCY     200
+#define MIN_LATENCY         100
+#define MAX_LATENCY         10000
+#define DEFAULT_LOOP_TIME   (-1)
+#define DEFAULT_SPECTRUM_TIME (-1)
+#define DEFAULT_CHANNELS    1
+
+/* Seconds after the output starts over which underruns are reported */
+#define STARTUP_WINDOW      2
+
+/* With --low-latency: the latency floor and default, in ms, and the
+ * frames per block */
+#define LOW_LATENCY_MIN     5
+#define LOW_LATENCY_DEFAULT 10
+#define LOW_LATENCY_BLOCK   32
+
+/* With --power-save: what is left in the output, in ms, when it is
+ * refilled, and how late timers may fire, in ns */
+#define POWER_WATERMARK     500
+#define POWER_SLACK         50000000L
 
 
 volatile int shutdown = 0;
@@ -53,6 +84,151 @@ void catchSIGINT( int signal )
 }
 
 
+#ifdef HAS_FFTW3
+/* Spectrum analyzer watching the output, if any */
+analyzer* output_tap = NULL;
+#endif
+
+/* Send 'size' frames of noise to the sound card, and to anything
+ * watching */
+void output_block( audio_dev_handle* handle, unsigned char* block, int size )
+{
+    if (audio_write(handle, block, size) < 0)
+    {
+        /* The output is gone; wind down as if interrupted */
+        shutdown = 1;
+    }
+#ifdef HAS_FFTW3
+    if (output_tap != NULL)
+    {
+        analyzer_tap(output_tap, block, size, handle->channels);
+    }
+#endif
+}
+
+
+static double ms_between( const struct timespec* from, const struct timespec* to )
+{
+    return (double) (to->tv_sec - from->tv_sec) * 1e3 +
+           (double) (to->tv_nsec - from->tv_nsec) * 1e-6;
+}
+
+
+/* Report how long after 'launch' the output started playing, and then
+ * how many underruns it had over the first STARTUP_WINDOW seconds.
+ * '*stage' counts the reports made so far. */
+void report_startup( audio_dev_handle* handle, const struct timespec* launch, int* stage )
+{
+    struct timespec now;
+
+    if (*stage == 0 && handle->started)
+    {
+        printf("Playback started after %.1f ms, with %.0f ms pre-rolled.\n",
+               ms_between(launch, &handle->startTime),
+               1e3 * handle->preroll / handle->rate);
+        (*stage)++;
+    }
+    else if (*stage == 1)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (ms_between(&handle->startTime, &now) >= STARTUP_WINDOW * 1e3)
+        {
+            printf("%ld underrun%s in the first %d seconds.\n", handle->xruns,
+                   handle->xruns == 1 ? "" : "s", STARTUP_WINDOW);
+            (*stage)++;
+        }
+    }
+}
+
+
+/* Output delay sampled after each block, in frames */
+typedef struct
+{
+    long min;
+    long max;
+    double sum;
+    long count;
+} delay_stats;
+
+
+/* Ask the output how much is queued ahead of what is being heard, now
+ * that a block has been added; a command acted on now is heard this
+ * much later */
+void measure_delay( audio_dev_handle* handle, delay_stats* d )
+{
+    long delay;
+
+    if (!handle->started || (delay = audio_delay(handle)) < 0)
+    {
+        return;
+    }
+    if (d->count == 0 || delay < d->min)
+    {
+        d->min = delay;
+    }
+    if (d->count == 0 || delay > d->max)
+    {
+        d->max = delay;
+    }
+    d->sum += delay;
+    d->count++;
+}
+
+
+void report_delay( audio_dev_handle* handle, delay_stats* d )
+{
+    if (d->count > 0)
+    {
+        printf("Output delay after each block: %.1f ms on average, %.1f to %.1f ms.\n",
+               1e3 * d->sum / d->count / handle->rate, 1e3 * d->min / handle->rate,
+               1e3 * d->max / handle->rate);
+    }
+}
+
+
+/* With --power-save, let the output sleep until it is down to
+ * POWER_WATERMARK ms, or a quarter of its buffer, and then refill it in
+ * one burst */
+void power_wakeup( audio_dev_handle* handle )
+{
+    long low = (long) POWER_WATERMARK * handle->rate / 1000;
+
+    if (handle->buffer <= 0)
+    {
+        fprintf(stderr, "Warning: this output cannot be refilled in bursts.\n");
+        return;
+    }
+    if (low > handle->buffer / 4)
+    {
+        low = handle->buffer / 4;
+    }
+    audio_set_wakeup(handle, handle->buffer - low);
+    printf("Output buffer of %.2f s, refilled in bursts of %.2f s.\n",
+           (double) handle->buffer / handle->rate,
+           (double) (handle->buffer - low) / handle->rate);
+}
+
+
+/* Seconds the run has lasted since 'start'.  An output which takes the
+ * noise as fast as it is made is not timed by the clock, but by what has
+ * been written since it had written 'written'. */
+double run_elapsed( audio_dev_handle* handle, time_t start, double written )
+{
+    if (handle->unpaced)
+    {
+        return handle->written - written;
+    }
+    return (double) (time(NULL) - start);
+}
+
+
+/* Offline renders stop when interrupted */
+int render_interrupted( void* arg )
+{
+    return shutdown;
+}
+
+
 /* Parse command-line flag to read the attached argument.  Allows
  * for optional whitespace between the flag and the arg. */
 const char * get_flag_val(int argc, char *argv[], int *p_currarg)
@@ -71,12 +247,24 @@ const char * get_flag_val(int argc, char *argv[], int *p_currarg)
 }
 
 
+/* Parse a long option, whose argument must follow as a separate word. */
+const char * get_long_flag_val(int argc, char *argv[], int *p_currarg)
+{
+    if ((*p_currarg) + 1 < argc)
+    {
+        (*p_currarg)++;
+        return argv[*p_currarg];
+    }
+
+    return NULL;
+}
+
+
 int main(int argc, char* argv[]) 
 {
     int i;
     const char* flag_val;
     double* coeff = NULL; 
-    unsigned char* data = NULL;
     unsigned char* filteredData = NULL;
     
     int filterLength = DEFAULT_FILTER_LEN;
@@ -85,32 +273,89 @@ int main(int argc, char* argv[])
     int filterType = DEFAULT_FILTER;
     int acount;
     time_t startTime;
+    double startWritten = 0.0;
+    struct timespec launchTime;
+    int startupStage = 0;
     int runTime = DEFAULT_RUN_TIME;
     int fadeTime = DEFAULT_FADE_TIME;
+    int channels = DEFAULT_CHANNELS;
+    noise_gen noise;
+    uint64_t seed = 0;
+    int seeded = 0;
     double dy;
     double dtemp;
-    double ddata;
+    unsigned char* block;
+    int blockSize;
+
+    int loopTime = DEFAULT_LOOP_TIME;
+    int looping = 0;
+    loop_player loop;
+
+    int multirate = 0;
+    multirate_gen mr;
+
+    fused_gen* tiles = NULL;
+
+    /* Lowering the filter quality when short of time */
+    int adaptive = 0;
+    adapt_gen quality;
+
+    /* Synthesizing a spectral shape instead of filtering */
+    int shaped = 0;
+
+    /* Every buffer the audio path touches */
+    arena mem = { NULL, 0, 0 };
+    size_t arenaSize;
+    int hugePages = 0;
+
+    int autoKernel = 1;
+    int tuning = 0;
+
+    int renderTime = 0;
+    unsigned char* rendered = NULL;
+    long renderTotal, renderDone, renderSegment, renderPos;
+
+    rt_options rt = { 0, 0, 0, NULL, 0 };
 
 #ifdef HAS_FFTW3
-    double* fft_in = NULL;
-    fftw_complex* fft_out = NULL;
-    fftw_plan fft_plan = NULL;
     int do_plot = 0;
     int plotWidth = DEFAULT_PLOT_WIDTH;
+    plotter plot;
+    int spectrumTime = DEFAULT_SPECTRUM_TIME;
+    analyzer spectrum;
+    spectral_gen shape;
 #endif
 
-    int use_arts = 0;
+    const char* output = NULL;
     audio_dev_handle audio_handle;
+    int status = 0;
 
-    int latency = DEFAULT_LATENCY;
+    int latency = -1;
+    int minLatency;
+    int defaultLatency;
+    int powerSave = 0;
+    rt_usage usage;
+    int measured = 0;
+    long queued;
+    int lowLatency = 0;
+    int blockFrames = SAMPLE_SIZE;
+    long tuneFrames;
+    delay_stats delays = { 0, 0, 0.0, 0 };
     int read_stdin = 0;
+    int ready;
     int readerr;
     char readbuf;
     char command[COMMAND_SIZE];
     int command_chars = 0;
 
 
+    clock_gettime(CLOCK_MONOTONIC, &launchTime);
     signal( SIGINT, catchSIGINT );  /* Exit cleanly on ^C */
+
+#ifdef HAS_FFTW3
+    /* FFTW itself is only set up once a plot is drawn */
+    plot_init(&plot);
+#endif
         
 
     /* Parse through command-line options */    
@@ -168,9 +413,9 @@ int main(int argc, char* argv[])
             flag_val = get_flag_val(argc, argv, &acount);
             if (flag_val != NULL) filterLength = atoi(flag_val);
             
-            if (filterLength <= 0 || filterLength > 100)
+            if (filterLength <= 0 || filterLength > MAX_FILTER_LEN)
             {
-                fprintf(stderr, "\nError: Filter length must be in the range [1, 100].\n");
+                fprintf(stderr, "\nError: Filter length must be in the range [1, %d].\n", MAX_FILTER_LEN);
                 fprintf(stderr, "Setting filter length = %d.\n", DEFAULT_FILTER_LEN);
                 
                 filterLength = DEFAULT_FILTER_LEN;
@@ -198,6 +443,20 @@ int main(int argc, char* argv[])
                 fadeTime = DEFAULT_FADE_TIME;
             }
         }              
+        /* Play back a pre-rendered loop */
+        else if (strcmp( argv[acount], "--loop" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL) loopTime = atoi(flag_val);
+
+            if (loopTime <= 0)
+            {
+                fprintf(stderr, "\nError: Loop length must be a positive number of seconds.\n");
+                fprintf(stderr, "Generating noise continuously.\n");
+
+                loopTime = DEFAULT_LOOP_TIME;
+            }
+        }
 #ifdef HAS_FFTW3
         /* Generate a frequency response plot */
         else if (strncmp( argv[acount], "-p", 2 ) == 0)
@@ -212,28 +471,156 @@ int main(int argc, char* argv[])
                 plotWidth = DEFAULT_PLOT_WIDTH;
             }
         }              
+        /* Analyze the spectrum of the output */
+        else if (strcmp( argv[acount], "--spectrum" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL) spectrumTime = atoi(flag_val);
+
+            if (spectrumTime < 0)
+            {
+                spectrumTime = 0;
+            }
+        }
+        /* Synthesize any spectrum, rather than filter */
+        else if (strcmp( argv[acount], "--shape" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL)
+            {
+                shaped = spectral_parse(&shape, flag_val) == 0;
+                if (!shaped)
+                {
+                    fprintf(stderr, "Using the lowpass filter.\n");
+                }
+            }
+        }
 #endif
         else if (strncmp( argv[acount], "-L", 2 ) == 0)
         {
+            /* Checked once --low-latency is known */
             flag_val = get_flag_val(argc, argv, &acount);
             if (flag_val != NULL) latency = atoi(flag_val);
-            
-            if (latency < 100)
+        }              
+        else if (strcmp( argv[acount], "--low-latency" ) == 0)
+        {
+            lowLatency = 1;
+        }
+        else if (strcmp( argv[acount], "--power-save" ) == 0)
+        {
+            powerSave = 1;
+        }
+        else if (strcmp( argv[acount], "--channels" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL) channels = atoi(flag_val);
+
+            if (channels < 1 || channels > MAX_CHANNELS)
+            {
+                fprintf(stderr, "\nError: Number of channels must be in the range [1, %d].\n",
+                        MAX_CHANNELS);
+                fprintf(stderr, "Using default of %d.\n", DEFAULT_CHANNELS);
+
+                channels = DEFAULT_CHANNELS;
+            }
+        }
+        /* Render a fixed length as fast as possible */
+        else if (strcmp( argv[acount], "--render" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL) renderTime = atoi(flag_val);
+
+            if (renderTime <= 0)
+            {
+                fprintf(stderr, "\nError: Render length must be a positive number of seconds.\n");
+                fprintf(stderr, "Generating noise continuously.\n");
+
+                renderTime = 0;
+            }
+        }
+        /* Generate at a reduced rate and interpolate */
+        else if (strcmp( argv[acount], "--multirate" ) == 0)
+        {
+            multirate = 1;
+        }
+        /* Choose the filter implementation */
+        else if (strcmp( argv[acount], "--kernel" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL && filter_select(flag_val) == 0)
             {
-                latency = 100;
+                autoKernel = strcmp(flag_val, "auto") == 0;
             }
-            else if (latency > 10000)
+            else if (flag_val != NULL)
             {
-                latency = DEFAULT_LATENCY;
+                fprintf(stderr, "\nError: Unknown filter kernel \"%s\"; choose one of\n", flag_val);
+                fprintf(stderr, "auto");
+                for (i = 0; filter_kernels[i].name != NULL; i++)
+                {
+                    fprintf(stderr, ", %s", filter_kernels[i].name);
+                }
+                fprintf(stderr, ".\nUsing auto.\n");
             }
-        }              
-#ifdef HAS_ARTS
-        /* Use aRts */
-        else if (strcmp( argv[acount], "-a" ) == 0)
+        }
+        /* Generate the same noise every time */
+        else if (strcmp( argv[acount], "--seed" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL)
+            {
+                seed   = strtoull(flag_val, NULL, 0);
+                seeded = 1;
+            }
+        }
+        /* Check the signal path, and report */
+        else if (strcmp( argv[acount], "--selftest" ) == 0)
         {
-            use_arts = 1;
+            return selftest() == 0 ? 0 : EXIT_FAILURE;
+        }
+        /* Time the filter kernels afresh */
+        else if (strcmp( argv[acount], "--tune" ) == 0)
+        {
+            tuning = 1;
+        }
+        /* Realtime scheduling for the audio path */
+        else if (strcmp( argv[acount], "--realtime" ) == 0)
+        {
+            flag_val = get_long_flag_val(argc, argv, &acount);
+            if (flag_val != NULL) rt.priority = atoi(flag_val);
+
+            if (rt.priority <= 0 || rt.priority > 99)
+            {
+                fprintf(stderr, "\nError: Realtime priority must be in the range [1, 99].\n");
+                fprintf(stderr, "Using normal scheduling.\n");
+
+                rt.priority = 0;
+            }
+        }
+        else if (strcmp( argv[acount], "--round-robin" ) == 0)
+        {
+            rt.roundRobin = 1;
+        }
+        else if (strcmp( argv[acount], "--mlock" ) == 0)
+        {
+            rt.lockMemory = 1;
+        }
+        else if (strcmp( argv[acount], "--cpus" ) == 0)
+        {
+            rt.cpus = get_long_flag_val(argc, argv, &acount);
+        }
+        else if (strcmp( argv[acount], "--hugepages" ) == 0)
+        {
+            hugePages = 1;
+        }
+        else if (strcmp( argv[acount], "--adaptive" ) == 0)
+        {
+            adaptive = 1;
+        }
+        /* Choose the audio output */
+        else if (strncmp( argv[acount], "-o", 2 ) == 0)
+        {
+            output = get_flag_val(argc, argv, &acount);
         }
-#endif
         /* Output version information */
         else if (strcmp( argv[acount], "-v" ) == 0 ||
                  strcmp( argv[acount], "--version" ) == 0)
@@ -286,7 +673,8 @@ int main(int argc, char* argv[])
             printf("                        'LENGTH' is an integer in the range [1 100],\n");
             printf("                        with a default value of 25.\n\n"); 
             printf("    -t TIME             Sets the length of time to generate\n");
-            printf("                        noise, in minutes.\n\n");
+            printf("                        noise, in minutes.  Into a file, this is\n");
+            printf("                        minutes of audio written.\n\n");
             printf("    -f FADETIME         Fade the noise out over 'FADETIME'\n");
             printf("                        seconds.  Valid only when used along\n");
             printf("                        with the '-t' flag.\n\n");
@@ -294,17 +682,79 @@ int main(int argc, char* argv[])
             printf("    -p WIDTH            Output a plot of the filter frequency response,\n");
             printf("                        'WIDTH' is the horizontal resolution of the\n");
             printf("                        PNG image, with default 320.  The image will\n");
-            printf("                        have filename ~/.whitenoise/filter.png .\n\n");
+            printf("                        have filename ~/.whitenoise/filter.png , and\n");
+            printf("                        a scalable copy is saved as filter.svg .\n\n");
+            printf("    --spectrum SECONDS  Measure the spectrum of the noise actually\n");
+            printf("                        being played, and write it to the file\n");
+            printf("                        ~/.whitenoise/spectrum-data every 'SECONDS'\n");
+            printf("                        seconds (or only on request, if 0).\n\n");
+            printf("    --shape SHAPE       Give the noise the spectrum 'SHAPE' instead of\n");
+            printf("                        lowpass filtering it: a file with a frequency\n");
+            printf("                        in Hz and a level in dB on each line, or such\n");
+            printf("                        pairs as \"100:0,1000:-6,8000:-30\".\n\n");
 #endif
             printf("    -L LATENCY          Configure the audio buffers for approximately\n");
             printf("                        'LATENCY' milliseconds of delay, with default\n");
-            printf("                        200.  Increase the value to alleviate\n");
-            printf("                        problems with skipping.\n\n");
-#ifdef HAS_ARTS
-            printf("    -a                  Interface with aRts instead of opening\n");
-            printf("                        /dev/dsp directly.\n\n");
-#endif
+            printf("                        200, and at least %d.  Increase the value\n",
+                   MIN_LATENCY);
+            printf("                        to alleviate problems with skipping.\n\n");
+            printf("    --low-latency       Play in small blocks, so that commands are\n");
+            printf("                        heard within milliseconds.  -L then defaults\n");
+            printf("                        to %d and may go down to %d.\n\n",
+                   LOW_LATENCY_DEFAULT, LOW_LATENCY_MIN);
+            printf("    --power-save        Take the largest output buffer, refill it in\n");
+            printf("                        bursts and sleep in between, to save power.\n");
+            printf("                        -L then defaults to %d.\n\n", MAX_LATENCY);
+            printf("    -o OUTPUT           Send the noise to 'OUTPUT', one of:\n");
+            for (i = 0; audio_backends[i] != NULL; i++)
+            {
+                printf("                           %-18s", audio_backends[i]->usage);
+                for (flag_val = audio_backends[i]->help; *flag_val != '\0'; flag_val++)
+                {
+                    putchar(*flag_val);
+                    if (*flag_val == '\n')
+                    {
+                        printf("%45s", "");
+                    }
+                }
+                printf("\n");
+            }
+            printf("                        The default is %s.\n\n", audio_backends[0]->name);
+            printf("    --channels N        Play 'N' independent noise channels, in the\n");
+            printf("                        range [1, %d], with default 1.\n\n", MAX_CHANNELS);
+            printf("    --loop SECONDS      Render a seamless loop of 'SECONDS' length in\n");
+            printf("                        the background, and play it back repeatedly\n");
+            printf("                        instead of generating noise continuously.\n\n");
+            printf("    --render SECONDS    Render 'SECONDS' of noise as fast as the\n");
+            printf("                        output takes it, on every core, and exit.\n\n");
+            printf("    --multirate         Generate the noise at a fraction of the\n");
+            printf("                        output rate and interpolate, which is much\n");
+            printf("                        cheaper at low cutoffs.\n\n");
+            printf("    --kernel KERNEL     Filter with 'KERNEL': \"double\" for double\n");
+            printf("                        precision, \"q15\" for 16-bit fixed point,\n");
+            printf("                        \"folded\" for fixed point exploiting the\n");
+            printf("                        symmetry of the filter, \"fft\" for FFT\n");
+            printf("                        convolution, or \"auto\" (the default) for\n");
+            printf("                        the fastest on this machine.\n\n");
+            printf("    --seed N            Seed the noise with 'N', so that the same\n");
+            printf("                        options always give the same output.\n\n");
+            printf("    --realtime PRIO     Render and play with realtime priority 'PRIO',\n");
+            printf("                        in the range [1, 99], using SCHED_FIFO.\n\n");
+            printf("    --round-robin       Use SCHED_RR rather than SCHED_FIFO.\n\n");
+            printf("    --mlock             Lock all memory, and prefault the stack and\n");
+            printf("                        heap used by the audio path.\n\n");
+            printf("    --cpus LIST         Pin the audio path to the CPUs in 'LIST',\n");
+            printf("                        for example \"2,3\" or \"0-3\".\n\n");
+            printf("    --hugepages         Keep the audio buffers in huge pages, if the\n");
+            printf("                        system has any to spare.\n\n");
+            printf("    --adaptive          Shorten the filter, or fall back to a cheap\n");
+            printf("                        IIR lowpass, while rendering is too slow to\n");
+            printf("                        keep up, and restore it once the load eases.\n\n");
             printf("    -s                  Read commands from stdin in realtime.\n\n");
+            printf("    --selftest          Check the filter kernels and noise source\n");
+            printf("                        against reference versions, and exit.\n\n");
+            printf("    --tune              Time every filter kernel for the current\n");
+            printf("                        options, remember the fastest, and exit.\n\n");
             printf("    -v, --version       Print version information.\n\n");    
             printf("    -?, --help          This help page.\n\n");
             return(0);
@@ -313,44 +763,216 @@ int main(int argc, char* argv[])
         acount++;
     }
        
-    // (Either succeeds or aborts the program)
-    audio_init(&audio_handle, rate, latency, use_arts);
-    
-    /* Create the lowpass filter for a given length */
-    if ((coeff = (double *) calloc(filterLength, sizeof(double))) == NULL)
+    if (!seeded)
     {
-        fprintf(stderr, "Error: could not allocate filter of length %d.\n", filterLength);
-        goto cleanup;
+        seed = ((uint64_t) time(NULL) << 16) ^ (uint64_t) getpid();
+    }
+
+    /* Loops and multirate are both made with the filter */
+    if (shaped && (multirate || loopTime > 0))
+    {
+        fprintf(stderr, "Warning: --multirate and --loop do not apply to a shape; "
+                        "ignoring them.\n");
+        multirate = 0;
+        loopTime  = 0;
+    }
+    /* Small blocks leave the multirate filter no lookahead */
+    if (lowLatency && multirate)
+    {
+        fprintf(stderr, "Warning: --multirate needs full blocks; ignoring it with "
+                        "--low-latency.\n");
+        multirate = 0;
+    }
+    if (lowLatency && powerSave)
+    {
+        fprintf(stderr, "Warning: --power-save works against --low-latency; "
+                        "ignoring it.\n");
+        powerSave = 0;
+    }
+    if (lowLatency)
+    {
+        blockFrames = LOW_LATENCY_BLOCK;
+    }
+    if (powerSave)
+    {
+        rt.timerSlack = POWER_SLACK;
+    }
+    /* Small blocks hand the kernels short pieces; time them on those */
+    tuneFrames = FUSED_TILE_BYTES / channels;
+    if (lowLatency && blockFrames < tuneFrames)
+    {
+        tuneFrames = blockFrames;
+    }
+
+    minLatency = lowLatency ? LOW_LATENCY_MIN : MIN_LATENCY;
+    defaultLatency = lowLatency ? LOW_LATENCY_DEFAULT :
+                     (powerSave ? MAX_LATENCY : DEFAULT_LATENCY);
+    if (latency < 0)
+    {
+        latency = defaultLatency;
+    }
+    else if (latency < minLatency)
+    {
+        latency = minLatency;
+    }
+    else if (latency > MAX_LATENCY)
+    {
+        latency = defaultLatency;
+    }
+
+    if (adaptive && (shaped || multirate))
+    {
+        fprintf(stderr, "Warning: --adaptive only applies to the direct filter; "
+                        "ignoring it.\n");
+        adaptive = 0;
+    }
+    /* What these play depends on timing, so a render could not match it */
+    if (renderTime > 0 && (adaptive || loopTime > 0))
+    {
+        fprintf(stderr, "Warning: --adaptive and --loop do not apply to --render; "
+                        "ignoring them.\n");
+        adaptive = 0;
+        loopTime = 0;
     }
-    getFilterCoeff( filterType, coeff, filterLength, cutoff );  
 
+    if (tuning)
+    {
+        double taps[MAX_FILTER_LEN];
+
+        computeFilterCoeff(filterType, taps, filterLength, cutoff);
+        if (arena_init(&mem, tune_size(channels, tuneFrames), 0) < 0 ||
+            tune_init(&mem, channels, tuneFrames) < 0 ||
+            tune_kernel(taps, filterLength,
+                        TUNE_MEASURE | TUNE_REPORT | (seeded ? TUNE_EXACT : 0)) < 0)
+        {
+            status = EXIT_FAILURE;
+        }
+        tune_exit();
+        arena_exit(&mem);
+        /* Keep the FFTW plans made for the timing */
+        filter_exit();
 #ifdef HAS_FFTW3
-    /* Initialize FFTW */
-    if ((fft_in = (double *) fftw_malloc(FFT_SIZE * sizeof(double))) == NULL ||
-        (fft_out = (fftw_complex *) fftw_malloc((FFT_SIZE/2 + 1) * sizeof(fftw_complex))) == NULL)
+        fft_exit();
+#endif
+        return status;
+    }
+
+    if (audio_init(&audio_handle, output, rate, latency, channels) < 0)
     {
-        fprintf(stderr, "Error: could not allocate FFT memory.\n");
+        status = EXIT_FAILURE;
         goto cleanup;
     }
-    
-    if ((fft_plan = fftw_plan_dft_r2c_1d(FFT_SIZE, fft_in, fft_out, FFTW_ESTIMATE)) == NULL) {
-        fprintf(stderr, "Error: could not create FFT plan.\n");
-        goto cleanup;
+    /* Some outputs can only run at their own rate */
+    rate = audio_handle.rate;
+    if (lowLatency && audio_handle.buffer > 0)
+    {
+        printf("Output buffer of %ld frames (%.1f ms), filled in blocks of %d (%.1f ms).\n",
+               audio_handle.buffer, 1e3 * audio_handle.buffer / rate, blockFrames,
+               1e3 * blockFrames / rate);
+    }
+    if (powerSave)
+    {
+        power_wakeup(&audio_handle);
     }
     
-    if (do_plot)
+    /* Set aside the buffers for the audio path in one go, so that nothing
+     * is allocated once playing.  The filter has room for any length. */
+    arenaSize = ARENA_SPACE(MAX_FILTER_LEN * sizeof(double)) +
+                ARENA_SPACE(SAMPLE_SIZE * channels) +
+                ARENA_SPACE(sizeof(fused_gen)) +
+                tune_size(channels, tuneFrames) +
+                (multirate ? multirate_size(channels, SAMPLE_SIZE) : 0) +
+                (adaptive ? adapt_size(channels, blockFrames) : 0);
+#ifdef HAS_FFTW3
+    if (shaped)
     {
-        plotFilter(coeff, filterLength, fft_in, fft_out, fft_plan, rate, plotWidth);
+        arenaSize += spectral_size(channels);
     }
 #endif
-    
-    if ((data = (unsigned char *) malloc(SAMPLE_SIZE * 2)) == NULL ||
-        (filteredData = (unsigned char *) malloc(SAMPLE_SIZE)) == NULL)
+    if (arena_init(&mem, arenaSize, hugePages) < 0 ||
+        (coeff = (double *) arena_alloc(&mem, MAX_FILTER_LEN * sizeof(double))) == NULL ||
+        (filteredData = (unsigned char *) arena_alloc(&mem, SAMPLE_SIZE * channels)) == NULL ||
+        (tiles = (fused_gen *) arena_alloc(&mem, sizeof(fused_gen))) == NULL)
     {
-        fprintf(stderr, "Error: could not allocate filter memory.\n");
+        fprintf(stderr, "Error: could not allocate audio buffers.\n");
+        status = EXIT_FAILURE;
         goto cleanup;
     }
+    if (multirate && multirate_init(&mr, &mem, channels, SAMPLE_SIZE) < 0)
+    {
+        fprintf(stderr, "Error: could not allocate multirate buffers.\n");
+        fprintf(stderr, "Generating at the full rate.\n");
+        multirate = 0;
+    }
+    if (adaptive && adapt_init(&quality, &mem, channels, blockFrames, rate) < 0)
+    {
+        fprintf(stderr, "Error: could not allocate adaptive filter buffers.\n");
+        fprintf(stderr, "Filtering at full quality throughout.\n");
+        adaptive = 0;
+    }
+#ifdef HAS_FFTW3
+    if (shaped && spectral_init(&shape, &mem, channels, rate) < 0)
+    {
+        fprintf(stderr, "Error: could not set up the spectral shape.\n");
+        fprintf(stderr, "Using the lowpass filter.\n");
+        spectral_exit(&shape);
+        shaped = 0;
+    }
+#endif
+
+    /* Any kernel may be picked on the fly when choosing automatically */
+    filter_init(autoKernel);
 
+    /* Create the lowpass filter for a given length */
+    if (shaped)
+    {
+        /* Kept for the commands, but not played */
+        computeFilterCoeff(filterType, coeff, filterLength, cutoff);
+    }
+    else
+    {
+        getFilterCoeff( filterType, coeff, filterLength, cutoff );  
+    }
+    if (!shaped && autoKernel && tune_init(&mem, channels, tuneFrames) == 0)
+    {
+        /* Seeded noise must come out the same on any machine */
+        tune_kernel(coeff, filterLength, seeded ? TUNE_EXACT : 0);
+    }
+
+    /* Live noise is played until the first loop has been rendered */
+    if (loopTime > 0)
+    {
+        if (loop_init(&loop, loopTime, channels, seeded, seed) < 0)
+        {
+            fprintf(stderr, "Error: could not start loop renderer.\n");
+            fprintf(stderr, "Generating noise continuously.\n");
+        }
+        else
+        {
+            looping = 1;
+            loop_request(&loop, coeff, filterLength, rate);
+        }
+    }
+
+#ifdef HAS_FFTW3
+    if (do_plot)
+    {
+        plotFilter(&plot, coeff, filterLength, rate, plotWidth);
+    }
+
+    if (spectrumTime >= 0)
+    {
+        if (analyzer_init(&spectrum, rate, spectrumTime) < 0)
+        {
+            fprintf(stderr, "Error: could not start spectrum analyzer.\n");
+        }
+        else
+        {
+            output_tap = &spectrum;
+        }
+    }
+#endif
+    
     startTime = time(NULL); 
     if (runTime > 0)
     {  
@@ -365,21 +987,126 @@ int main(int argc, char* argv[])
         }
     }
 
+    /* Everything the audio path needs is allocated by now */
+    rt_setup(&rt);
+
     /* Generate uniform random noise, and lowpass filter it. */
-    for(i=0; i<SAMPLE_SIZE; i++)
+    noise_init(&noise, seed, channels);
+
+    if (renderTime > 0)
+    {
+        /* Render ahead in segments big enough to keep every core busy.
+         * The result is exactly what would have been played live. */
+        renderTotal   = (long) renderTime * rate;
+        renderSegment = 4L * render_threads() * RENDER_CHUNK;
+        if (renderSegment > renderTotal)
+        {
+            renderSegment = renderTotal;
+        }
+        if ((rendered = (unsigned char *) malloc(renderSegment * channels)) == NULL)
+        {
+            fprintf(stderr, "Error: could not allocate render memory.\n");
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+
+        if (multirate)
+        {
+            /* As for live multirate noise, below */
+            noise_skip(&noise, SAMPLE_SIZE);
+            multirate_design(&mr, &noise, filterType, filterLength, cutoff);
+        }
+#ifdef HAS_FFTW3
+        else if (shaped)
+        {
+            spectral_start(&shape, &noise);
+        }
+#endif
+        printf("Rendering %d seconds of noise.\n", renderTime);
+        for (renderDone = 0; renderDone < renderTotal && !shutdown; renderDone += blockSize)
+        {
+            blockSize = renderTotal - renderDone < renderSegment ?
+                        renderTotal - renderDone : renderSegment;
+            if (multirate)
+            {
+                /* Serial as well, and in whole blocks as when live */
+                for (renderPos = 0; renderPos < blockSize; renderPos += SAMPLE_SIZE)
+                {
+                    if (blockSize - renderPos >= SAMPLE_SIZE)
+                    {
+                        multirate_render(&mr, &noise, rendered + renderPos * channels);
+                    }
+                    else
+                    {
+                        multirate_render(&mr, &noise, filteredData);
+                        memcpy(rendered + renderPos * channels, filteredData,
+                               (blockSize - renderPos) * channels);
+                    }
+                }
+            }
+#ifdef HAS_FFTW3
+            else if (shaped)
+            {
+                /* Each frame depends on the last, so this is serial */
+                spectral_render(&shape, &noise, rendered, blockSize);
+            }
+#endif
+            else if (render_noise(&noise, rendered, blockSize, coeff, filterLength, 0,
+                                  render_interrupted, NULL) < 0)
+            {
+                if (!shutdown)
+                {
+                    fprintf(stderr, "Error: rendering failed.\n");
+                    status = EXIT_FAILURE;
+                }
+                break;
+            }
+            output_block(&audio_handle, rendered, blockSize);
+        }
+        goto cleanup;
+    }
+
+    if (multirate)
+    {
+        /* Seeded multirate noise has always started a block in */
+        noise_skip(&noise, SAMPLE_SIZE);
+        multirate_design(&mr, &noise, filterType, filterLength, cutoff);
+    }
+#ifdef HAS_FFTW3
+    else if (shaped)
     {
-        *(data+i) = rand();
+        spectral_start(&shape, &noise);
+    }
+#endif
+    else
+    {
+        /* Generate, filter and write each block in one pass */
+        fused_init(tiles, &noise, filterLength);
+        if (adaptive)
+        {
+            adapt_design(&quality, filterType, filterLength, cutoff);
+        }
     }
     
     
+    rt_usage_mark(&usage);
+    measured = 1;
     memset(command, 0, sizeof(command));
-    while(!shutdown && (time(NULL)-startTime < runTime || runTime < 0))
+    while(!shutdown && (run_elapsed(&audio_handle, startTime, startWritten) < runTime ||
+                        runTime < 0))
     {
-        if (read_stdin)
+        /* Sleep until the output has room for a block, or a command
+         * arrives */
+        ready = audio_wait(&audio_handle, read_stdin ? 0 : -1, blockFrames);
+        if (ready < 0)
+        {
+            break;
+        }
+
+        if (ready & AUDIO_INPUT)
         {
-            /* Read commands from stdin */
-            readerr = read(0, &readbuf, 1);
-            if (readerr != -1) 
+            /* Read commands from stdin, as many as have arrived */
+            while ((readerr = read(0, &readbuf, 1)) == 1)
             {
                 if (readbuf != '\n') 
                 {
@@ -408,6 +1135,18 @@ int main(int argc, char* argv[])
                             cutoff = DEFAULT_CUTOFF;
                         }
                         getFilterCoeff( filterType, coeff, filterLength, cutoff );  
+                        if (multirate)
+                        {
+                            multirate_design(&mr, &noise, filterType, filterLength, cutoff);
+                        }
+                        if (adaptive)
+                        {
+                            adapt_design(&quality, filterType, filterLength, cutoff);
+                        }
+                        if (looping)
+                        {
+                            loop_request(&loop, coeff, filterLength, rate);
+                        }
                     }
                     /* set samplerate */
                     else if (command[0] == 'r')
@@ -417,7 +1156,33 @@ int main(int argc, char* argv[])
                         {
                             rate = DEFAULT_RATE;
                         }
-                        audio_set_rate(&audio_handle, rate);
+                        if (audio_set_rate(&audio_handle, rate) < 0)
+                        {
+                            shutdown = 1;
+                        }
+                        rate = audio_handle.rate;
+                        if (powerSave && !shutdown)
+                        {
+                            power_wakeup(&audio_handle);
+                        }
+#ifdef HAS_FFTW3
+                        if (output_tap != NULL)
+                        {
+                            analyzer_set_rate(output_tap, rate);
+                        }
+                        if (shaped)
+                        {
+                            spectral_set_rate(&shape, rate);
+                        }
+#endif
+                        if (adaptive)
+                        {
+                            adapt_set_rate(&quality, rate);
+                        }
+                        if (looping)
+                        {
+                            loop_request(&loop, coeff, filterLength, rate);
+                        }
                     }
                     /* change filter type */
                     else if (command[0] == 'F') 
@@ -428,27 +1193,51 @@ int main(int argc, char* argv[])
                             filterType = DEFAULT_FILTER;
                         }
                         getFilterCoeff( filterType, coeff, filterLength, cutoff );  
+                        if (multirate)
+                        {
+                            multirate_design(&mr, &noise, filterType, filterLength, cutoff);
+                        }
+                        if (adaptive)
+                        {
+                            adapt_design(&quality, filterType, filterLength, cutoff);
+                        }
+                        if (looping)
+                        {
+                            loop_request(&loop, coeff, filterLength, rate);
+                        }
                     }
                     /* change filter length */
                     else if (command[0] == 'l')
                     {
                         filterLength = atoi(&command[1]);
-                        if (filterLength <= 0 || filterLength > 100)
+                        if (filterLength <= 0 || filterLength > MAX_FILTER_LEN)
                         {
                             filterLength = DEFAULT_FILTER_LEN;
                         }
-                        free(coeff);
-                        if ((coeff = (double *) calloc(filterLength, sizeof(double))) == NULL)
+                        getFilterCoeff( filterType, coeff, filterLength, cutoff );  
+                        if (autoKernel)
                         {
-                            goto cleanup;
+                            tune_request(coeff, filterLength, seeded ? TUNE_EXACT : 0);
+                        }
+                        if (multirate)
+                        {
+                            multirate_design(&mr, &noise, filterType, filterLength, cutoff);
+                        }
+                        if (adaptive)
+                        {
+                            adapt_design(&quality, filterType, filterLength, cutoff);
+                        }
+                        if (looping)
+                        {
+                            loop_request(&loop, coeff, filterLength, rate);
                         }
-                        getFilterCoeff( filterType, coeff, filterLength, cutoff );  
                     }      
                     /* set run time, in minutes */
                     else if (command[0] == 't')
                     {
                         runTime = 60*atoi(&command[1]);
                         startTime = time(NULL);
+                        startWritten = audio_handle.written;
                         if (runTime <= 0)
                         {
                             runTime = DEFAULT_RUN_TIME;
@@ -472,18 +1261,37 @@ int main(int argc, char* argv[])
                         {
                             plotWidth = DEFAULT_PLOT_WIDTH;
                         }
-                        plotFilter(coeff, filterLength, fft_in, fft_out, fft_plan, rate, plotWidth);
+                        plotFilter(&plot, coeff, filterLength, rate, plotWidth);
+                    }
+                    /* write out the measured spectrum */
+                    else if (command[0] == 'S')
+                    {
+                        if (output_tap == NULL && analyzer_init(&spectrum, rate, 0) == 0)
+                        {
+                            output_tap = &spectrum;
+                        }
+                        if (output_tap != NULL)
+                        {
+                            analyzer_dump(output_tap);
+                        }
                     }
 #endif
                     /* set the latency */
                     else if (command[0] == 'L')
                     {
                         latency = atoi(&command[1]);
-                        if (latency < 100 || latency > 10000)
+                        if (latency < minLatency || latency > MAX_LATENCY)
+                        {
+                            latency = defaultLatency;
+                        }
+                        if (audio_set_latency(&audio_handle, latency) < 0)
+                        {
+                            shutdown = 1;
+                        }
+                        else if (powerSave)
                         {
-                            latency = DEFAULT_LATENCY;
+                            power_wakeup(&audio_handle);
                         }
-                        audio_set_latency(&audio_handle, latency);
                     }
                     /* quit */
                     else if (command[0] == 'q')
@@ -495,25 +1303,63 @@ int main(int argc, char* argv[])
                     command_chars = 0;
                 }
             }
+            if (readerr == 0)
+            {
+                /* End of input; stop watching it */
+                read_stdin = 0;
+            }
         }
 
+        if (!(ready & AUDIO_WRITABLE))
+        {
+            continue;
+        }
+        report_startup(&audio_handle, &launchTime, &startupStage);
 
-        for (i = SAMPLE_SIZE; i < SAMPLE_SIZE * 2; i++) 
+        if (looping && loop_update(&loop))
         {
-            *(data+i) = rand();
+            /* Stream straight out of the pre-rendered loop */
+            block = loop_next(&loop, blockFrames, &blockSize);
+            output_block(&audio_handle, block, blockSize);
+            continue;
         }
 
-        filter(data, filteredData, SAMPLE_SIZE, coeff, filterLength); 
+        /* Render straight into the output's memory, if it allows */
+        if ((block = audio_buffer(&audio_handle, blockFrames)) == NULL)
+        {
+            block = filteredData;
+        }
+        if (multirate)
+        {
+            multirate_render(&mr, &noise, block);
+        }
+#ifdef HAS_FFTW3
+        else if (shaped)
+        {
+            spectral_render(&shape, &noise, block, blockFrames);
+        }
+#endif
+        else if (adaptive)
+        {
+            adapt_render(&quality, tiles, &noise, block, coeff, NULL, 0.0);
+        }
+        else
+        {
+            fused_render(tiles, &noise, block, blockFrames, coeff, filterLength, NULL, 0.0);
+        }
         /* Output the filtered noise to the sound card. */
-        audio_write(&audio_handle, filteredData, SAMPLE_SIZE);
+        output_block(&audio_handle, block, blockFrames);
+        if (lowLatency)
+        {
+            measure_delay(&audio_handle, &delays);
+        }
     }
 
 
-    /* Fade the noise out for 'fadeTime' secs */
+    /* Fade the noise out over 'fadeTime' secs of audio */
     if (!shutdown && runTime >= 0 && fadeTime >= 0)
     {
         printf("Beginning fade...\n");
-        startTime = time(NULL);
         /* Use a linear function to dampen the amplitude.  */
         /* 'dtemp' is the dampening coefficient, and 'dy'  */
         /* is the constant amount by which it is decreased */
@@ -521,45 +1367,100 @@ int main(int argc, char* argv[])
         dtemp = 1.0;
         dy    = 1.0 / (((double) rate) * ((double) fadeTime));
         
-        while(time(NULL)-startTime <= fadeTime)
+        while(!shutdown && dtemp > 0.0)
         {
-            for (i = SAMPLE_SIZE; i < SAMPLE_SIZE * 2; i++) 
+            if (looping && loop_update(&loop))
             {
-                ddata = (double) ((unsigned char) rand());
-                ddata -= 128.0;
-                ddata *= dtemp;
-                ddata += 128.0;
-                
-                *(data+i) = (unsigned char) ddata;                
-                dtemp -= dy;
-                if (dtemp < 0.0)
-                {
-                    dtemp = 0.0;
-                }
+                /* Dampen the loop output itself, so the fade carries on
+                 * seamlessly from what was playing */
+                block = loop_next(&loop, blockFrames, &blockSize);
+                fade_block(filteredData, block, blockSize, channels, &dtemp, dy);
+                output_block(&audio_handle, filteredData, blockSize);
+                continue;
+            }
+            if (multirate)
+            {
+                /* Likewise after interpolation */
+                multirate_render(&mr, &noise, filteredData);
+                fade_block(filteredData, filteredData, blockFrames, channels, &dtemp, dy);
+                output_block(&audio_handle, filteredData, blockFrames);
+                continue;
+            }
+#ifdef HAS_FFTW3
+            if (shaped)
+            {
+                spectral_render(&shape, &noise, filteredData, blockFrames);
+                fade_block(filteredData, filteredData, blockFrames, channels, &dtemp, dy);
+                output_block(&audio_handle, filteredData, blockFrames);
+                continue;
             }
+#endif
 
-            filter(data, filteredData, SAMPLE_SIZE, coeff, filterLength); 
+            if (adaptive)
+            {
+                adapt_render(&quality, tiles, &noise, filteredData, coeff, &dtemp, dy);
+            }
+            else
+            {
+                fused_render(tiles, &noise, filteredData, blockFrames, coeff, filterLength,
+                             &dtemp, dy);
+            }
             /* Output the filtered noise to the sound card. */
-            audio_write(&audio_handle, filteredData, SAMPLE_SIZE);
+            output_block(&audio_handle, filteredData, blockFrames);
         }
     }
+
+    /* A run which ends by itself plays out what is still queued, which
+     * with --power-save may be several seconds; ^C and 'q' stop at once */
+    if (!shutdown && runTime >= 0)
+    {
+        audio_drain(&audio_handle);
+    }
             
     
 cleanup:
     /* Clean up */
-    free(coeff);
-    free(data);
-    free(filteredData);
+    if (looping)
+    {
+        loop_exit(&loop);
+    }
+    free(rendered);
+    if (adaptive)
+    {
+        adapt_report(&quality);
+    }
+    tune_exit();
+    arena_exit(&mem);
 
+    filter_exit();
 #ifdef HAS_FFTW3
-    if (fft_plan != NULL) fftw_destroy_plan(fft_plan);
-    if (fft_in != NULL) fftw_free(fft_in);
-    if (fft_out != NULL) fftw_free(fft_out);
-    fftw_cleanup();
+    if (output_tap != NULL)
+    {
+        analyzer_exit(output_tap);
+    }
+    if (shaped)
+    {
+        spectral_exit(&shape);
+    }
+    plot_exit(&plot);
+    fft_exit();
 #endif
 
+    report_delay(&audio_handle, &delays);
+    if (measured)
+    {
+        /* Count only what has been heard */
+        queued = audio_delay(&audio_handle);
+        rt_usage_report(&usage, audio_handle.written -
+                                (queued > 0 ? (double) queued / rate : 0.0));
+    }
+    if (audio_handle.xruns > 0)
+    {
+        printf("The output underran %ld time%s in all.\n", audio_handle.xruns,
+               audio_handle.xruns == 1 ? "" : "s");
+    }
     audio_exit(&audio_handle);
-    return(0);
+    return(status);
 }
 
 